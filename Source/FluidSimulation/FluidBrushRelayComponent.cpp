@@ -0,0 +1,15 @@
+#include "FluidBrushRelayComponent.h"
+#include "FluidGrid.h"
+
+UFluidBrushRelayComponent::UFluidBrushRelayComponent()
+{
+	SetIsReplicatedByDefault(true);
+}
+
+void UFluidBrushRelayComponent::Server_QueueBrushStroke_Implementation(AFluidGrid* Grid, FVector2D Uv, float Radius, FVector2D Velocity)
+{
+	if (Grid)
+	{
+		Grid->QueueBrushStroke(Uv, Radius, Velocity);
+	}
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "FluidBrushRelayComponent.generated.h"
+
+class AFluidGrid;
+
+// Carries a client's brush strokes to the authority for grids in bDeterministic mode. A level-placed grid
+// belongs to no client connection, so it cannot take their Server RPCs; this component goes on the player
+// controller instead. A client's QueueBrushStroke on a deterministic grid forwards through it, and the
+// authority logs the stroke for every machine as if it had been queued there.
+UCLASS(ClassGroup = "Fluid Simulation", meta = (BlueprintSpawnableComponent))
+class FLUIDSIMULATION_API UFluidBrushRelayComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	UFluidBrushRelayComponent();
+
+	// Reliable, so a stroke is only lost when the authority's log refuses it
+	UFUNCTION(Server, Reliable)
+	void Server_QueueBrushStroke(AFluidGrid* Grid, FVector2D Uv, float Radius, FVector2D Velocity);
+};
@@ -0,0 +1,40 @@
+#include "FluidFieldArena.h"
+
+FFluidFieldArena::~FFluidFieldArena()
+{
+	Release();
+}
+
+bool FFluidFieldArena::Allocate(int32 InGridSize, int32 InNumFields, int32 InDepth)
+{
+	if (Memory && GridSize == InGridSize && NumFields == InNumFields && Depth == InDepth)
+	{
+		return false;
+	}
+
+	Release();
+
+	constexpr int32 FloatsPerLine = Alignment / sizeof(float);
+	GridSize = InGridSize;
+	NumFields = InNumFields;
+	Depth = InDepth;
+	FieldStride = Align(GridSize * GridSize * Depth, FloatsPerLine);
+
+	const SIZE_T Bytes = (SIZE_T)FieldStride * NumFields * sizeof(float);
+	Memory = static_cast<float*>(FMemory::Malloc(Bytes, Alignment));
+	FMemory::Memzero(Memory, Bytes);
+	return true;
+}
+
+void FFluidFieldArena::Release()
+{
+	if (Memory)
+	{
+		FMemory::Free(Memory);
+		Memory = nullptr;
+	}
+	GridSize = 0;
+	NumFields = 0;
+	Depth = 1;
+	FieldStride = 0;
+}
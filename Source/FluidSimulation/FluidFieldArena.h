@@ -0,0 +1,38 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+// A single 64-byte aligned allocation holding every Size x Size (or Size^3, with a Depth of Size) float
+// field of a solver.
+// Each field starts on its own cache line, so front and back buffers are swapped by pointer instead of copied.
+class FLUIDSIMULATION_API FFluidFieldArena
+{
+public:
+	static constexpr int32 Alignment = 64;
+
+	FFluidFieldArena() = default;
+	~FFluidFieldArena();
+
+	FFluidFieldArena(const FFluidFieldArena&) = delete;
+	FFluidFieldArena& operator=(const FFluidFieldArena&) = delete;
+
+	// Reallocates and zeroes the arena only when the grid size, depth or field count changes. Returns true if it did.
+	bool Allocate(int32 InGridSize, int32 InNumFields, int32 InDepth = 1);
+	void Release();
+
+	float* GetField(int32 FieldIndex) const
+	{
+		check(Memory && FieldIndex >= 0 && FieldIndex < NumFields);
+		return Memory + FieldIndex * FieldStride;
+	}
+
+	int32 GetGridSize() const { return GridSize; }
+	bool IsAllocated() const { return Memory != nullptr; }
+
+private:
+	float* Memory = nullptr;
+	int32 GridSize = 0;
+	int32 NumFields = 0;
+	int32 Depth = 1; // Size x Size layers per field
+	int32 FieldStride = 0; // Floats between the start of two fields
+};
@@ -1,4 +1,5 @@
 #include "FluidGrid.h"
+#include "FluidSimulation.h"
 #include "Engine/World.h"
 #include "TimerManager.h"
 #include "Materials/MaterialInstanceDynamic.h"
@@ -11,16 +12,21 @@
 #include "RenderingThread.h"
 #include "DrawDebugHelpers.h"
 #include "Components/BoxComponent.h"
+#include "FluidSimStats.h"
+#include "FluidSimSubsystem.h"
+#include "FluidBrushRelayComponent.h"
+#include "Tasks/Task.h"
+#include "Net/UnrealNetwork.h"
+#include "Algo/BinarySearch.h"
 
 AFluidGrid::AFluidGrid()
 {
 	PrimaryActorTick.bCanEverTick = true;
 
-	int32 TotalSize = Size * Size;
-	Density.Init(0.0f, TotalSize);
-	Vx.Init(0.0f, TotalSize);
-	Vy.Init(0.0f, TotalSize);
-	Vz.Init(0.0f, TotalSize);
+	// Only bDeterministic's input log and step count replicate. A client that stops receiving them can
+	// not catch up, so the actor stays relevant at any distance.
+	bReplicates = true;
+	bAlwaysRelevant = true;
 
 	PlaneComponent = CreateDefaultSubobject<UStaticMeshComponent>(TEXT("PlaneComponent"));
 	RootComponent = PlaneComponent;
@@ -41,18 +47,258 @@ AFluidGrid::AFluidGrid()
 void AFluidGrid::InitializeRenderTarget()
 {
 	RenderTarget->InitAutoFormat(Size, Size);
-	RenderTarget->RenderTargetFormat = ETextureRenderTargetFormat::RTF_RGBA8;
+	RenderTarget->RenderTargetFormat = GetPresentationFormat();
 	RenderTarget->bForceLinearGamma = true;
-	RenderTarget->bAutoGenerateMips = true;
+	RenderTarget->bAutoGenerateMips = false; // The plane is seen at one fixed distance, so mips would only cost a regeneration per upload
+	RenderTarget->Filter = GetPresentationFilter();
 	RenderTarget->ClearColor = FLinearColor::Black;
+	RenderTarget->bCanCreateUAV = UsesGPUBackend();
 	RenderTarget->UpdateResource();
 }
 
+bool AFluidGrid::UsesDensityPresentation() const
+{
+	// The volume is always raw density, which the material maps through PaletteTexture as it marches
+	return IsVolumetric() || (PresentationMode != EFluidPresentationMode::Color && !UsesGPUBackend());
+}
+
+ETextureRenderTargetFormat AFluidGrid::GetPresentationFormat() const
+{
+	if (!UsesDensityPresentation())
+	{
+		return ETextureRenderTargetFormat::RTF_RGBA8;
+	}
+	return PresentationMode == EFluidPresentationMode::DensityR16F ? ETextureRenderTargetFormat::RTF_R16f : ETextureRenderTargetFormat::RTF_R8;
+}
+
+TextureFilter AFluidGrid::GetPresentationFilter() const
+{
+	return bSmoothPresentation ? TF_Bilinear : TF_Nearest;
+}
+
+void AFluidGrid::ApplyPresentationMode()
+{
+	// The texture comes back cleared in the new format, so the next present has to cover all of it
+	InitializeRenderTarget();
+	PresentedTiles = FFluidTileMask();
+	bPaletteTextureDirty = true;
+
+	if (DynamicMaterialInstance)
+	{
+		DynamicMaterialInstance->SetScalarParameterValue(FName("DensityPresentation"), UsesDensityPresentation() ? 1.0f : 0.0f);
+	}
+}
+
+void AFluidGrid::UpdatePaletteTexture()
+{
+	if (!UsesDensityPresentation() || (PaletteTexture && !bPaletteTextureDirty))
+	{
+		return;
+	}
+	bPaletteTextureDirty = false;
+
+	if (!PaletteTexture)
+	{
+		PaletteTexture = UTexture2D::CreateTransient(PaletteLUTSize, 1, PF_B8G8R8A8);
+		PaletteTexture->Filter = TF_Bilinear;
+		PaletteTexture->AddressX = TA_Clamp;
+		PaletteTexture->AddressY = TA_Clamp;
+		PaletteTexture->SRGB = false; // Same linear bytes the colour path writes into its linear-gamma target
+		PaletteTexture->UpdateResource();
+
+		if (DynamicMaterialInstance)
+		{
+			DynamicMaterialInstance->SetTextureParameterValue(FName("PaletteTexture"), PaletteTexture);
+		}
+	}
+
+	// The colour path keeps zero density black, so the first texel is black here
+	FColor* Texels = new FColor[PaletteLUTSize];
+	FMemory::Memcpy(Texels, PaletteLUT.GetData(), PaletteLUTSize * sizeof(FColor));
+	Texels[0] = FColor::Black;
+
+	FUpdateTextureRegion2D* Region = new FUpdateTextureRegion2D(0, 0, 0, 0, PaletteLUTSize, 1);
+	PaletteTexture->UpdateTextureRegions(0, 1, Region, PaletteLUTSize * sizeof(FColor), sizeof(FColor), (uint8*)Texels,
+		[](uint8* SrcData, const FUpdateTextureRegion2D* Regions)
+		{
+			delete[] (FColor*)SrcData;
+			delete Regions;
+		});
+}
+
+
+#if WITH_EDITOR
+void AFluidGrid::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+{
+	Super::PostEditChangeProperty(PropertyChangedEvent);
+
+	const FName PropertyName = PropertyChangedEvent.GetMemberPropertyName();
+	if (PropertyName == GET_MEMBER_NAME_CHECKED(AFluidGrid, PaletteStops) || PropertyName == GET_MEMBER_NAME_CHECKED(AFluidGrid, PaletteCurve))
+	{
+		bPaletteDirty = true;
+	}
+
+	// The texture may no longer match what the tile mask last presented (the GPU backend writes it directly)
+	PresentedTiles = FFluidTileMask();
+
+	if (PropertyName == GET_MEMBER_NAME_CHECKED(AFluidGrid, Size) && HasActorBegunPlay())
+	{
+		ResizeGrid(Size);
+	}
+}
+#endif
+
+void AFluidGrid::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME(AFluidGrid, InputLog);
+	DOREPLIFETIME(AFluidGrid, AuthorityStep);
+}
+
+bool AFluidGrid::UsesGPUBackend() const
+{
+	return SimulationBackend == EFluidSimulationBackend::GPU && !bDeterministic && !IsVolumetric();
+}
+
+bool AFluidGrid::UsesAsyncSimulation() const
+{
+	return bAsyncSimulation && !bDeterministic && !UsesGPUBackend() && !IsVolumetric();
+}
+
+void AFluidGrid::SetResolution(int32 NewSize)
+{
+	if (bDeterministic && HasActorBegunPlay())
+	{
+		LogParameterChange(EFluidSimLogEntryType::Resolution, NewSize);
+		return;
+	}
+	ResizeGrid(NewSize);
+}
+
+void AFluidGrid::ResizeGrid(int32 NewSize)
+{
+	NewSize = FMath::Clamp(NewSize, 16, 2048);
+
+	// Before BeginPlay nothing is allocated yet, and BeginPlay allocates at Size
+	if (!HasActorBegunPlay() || (RenderTarget->SizeX == NewSize && RenderTarget->SizeY == NewSize))
+	{
+		Size = NewSize;
+		return;
+	}
+
+	// The async task owns the solver while it runs
+	SimulationTask.Wait();
+
+	Size = NewSize;
+	if (!IsVolumetric())
+	{
+		Solver.Settings = MakeSolverSettings();
+		Solver.AllocateFields();
+	}
+	RenderTarget->ResizeTarget(Size, Size);
+
+	// Nothing presented or kept for presentation so far matches the new size. The async triple buffer
+	// drains by itself, since frames of the wrong size are never presented.
+	PresentedTiles = FFluidTileMask();
+	PreviousDensity.Reset();
+}
+
+void AFluidGrid::SetPressureIterations(int32 Iterations)
+{
+	if (bDeterministic && HasActorBegunPlay())
+	{
+		LogParameterChange(EFluidSimLogEntryType::PressureIterations, Iterations);
+		return;
+	}
+	PressureIterations = FMath::Max(Iterations, 1);
+}
+
+void AFluidGrid::SetVelocityResolution(EFluidVelocityResolution Resolution)
+{
+	if (bDeterministic && HasActorBegunPlay())
+	{
+		LogParameterChange(EFluidSimLogEntryType::VelocityResolution, (float)Resolution);
+		return;
+	}
+
+	// Takes effect in the next step's AllocateFields, which resamples the velocity
+	VelocityResolution = Resolution;
+}
+
+void AFluidGrid::SetSimRate(float Rate)
+{
+	if (bDeterministic && HasActorBegunPlay())
+	{
+		LogParameterChange(EFluidSimLogEntryType::SimRate, Rate);
+		return;
+	}
+	SimRate = FMath::Max(Rate, 1.0f);
+}
+
+float AFluidGrid::GetStepDt() const
+{
+	// Once per frame, Dt is the step as tuned. Fixed steps (bDeterministic always uses them) run SimRate
+	// times a second, so each one covers its share of ReferenceSimRate steps.
+	return bFixedTimestep || bDeterministic ? Dt * (ReferenceSimRate / SimRate) : Dt;
+}
+
+FFluidSolverSettings AFluidGrid::MakeSolverSettings() const
+{
+	FFluidSolverSettings Settings;
+	Settings.Size = Size;
+	Settings.AreaSize = AreaSize;
+	Settings.AffectedDensity = AffectedDensity;
+	Settings.AffectedVelocity = AffectedVelocity;
+	Settings.Dt = GetStepDt();
+	Settings.Diffusion = Diffusion;
+	Settings.Viscosity = Viscosity;
+	Settings.TurbulenceScale = TurbulenceScale;
+	Settings.TurbulenceSpeed = TurbulenceSpeed;
+	Settings.bUseTurbulenceTile = bUseTurbulenceTile;
+	Settings.TurbulenceRefreshInterval = TurbulenceRefreshInterval;
+	Settings.SolverOrdering = SolverOrdering;
+	Settings.TemporalBlockSweeps = TemporalBlockSweeps;
+	Settings.DiffuseIterations = DiffuseIterations;
+	Settings.PressureIterations = PressureIterations;
+	Settings.bLinearSolveEarlyExit = bLinearSolveEarlyExit;
+	Settings.LinearSolveTolerance = LinearSolveTolerance;
+	Settings.ResidualCheckInterval = ResidualCheckInterval;
+	Settings.PressureSolverType = PressureSolverType;
+	Settings.MultigridTolerance = MultigridTolerance;
+	Settings.MultigridMaxCycles = MultigridMaxCycles;
+	Settings.ConjugateGradientTolerance = ConjugateGradientTolerance;
+	Settings.ConjugateGradientMaxIterations = ConjugateGradientMaxIterations;
+	Settings.bMultigridPreconditioner = bMultigridPreconditioner;
+	Settings.bVectorizeProject = bVectorizeProject;
+	Settings.bVectorizeAdvect = bVectorizeAdvect;
+	Settings.bSparseTiles = bSparseTiles;
+	Settings.VelocityResolution = VelocityResolution;
+	Settings.FadeMode = FadeMode;
+	Settings.FadeRate = FadeRate;
+	Settings.bFuseFade = bFuseFade;
+	return Settings;
+}
 
 void AFluidGrid::BeginPlay()
 {
 	Super::BeginPlay();
 
+	if (IsVolumetric() && bDeterministic)
+	{
+		UE_LOG(LogFluidSimulation, Warning, TEXT("%s: bDeterministic is ignored in volume mode"), *GetPathName());
+		bDeterministic = false;
+	}
+
+	// Instances placed with an edited or spawn-time Size allocate at that size, not the default. The
+	// volume solver allocates on its first tick.
+	Size = FMath::Clamp(Size, 16, 2048);
+	if (!IsVolumetric())
+	{
+		Solver.Settings = MakeSolverSettings();
+		Solver.AllocateFields();
+	}
+	BeginStartupSnapshotLoad();
 	InitializeRenderTarget();
 
 	if (BaseMaterial)
@@ -61,474 +307,1170 @@ void AFluidGrid::BeginPlay()
 		if (DynamicMaterialInstance)
 		{
 			DynamicMaterialInstance->SetTextureParameterValue(FName("DynamicTexture"), RenderTarget);
+			DynamicMaterialInstance->SetScalarParameterValue(FName("DensityPresentation"), UsesDensityPresentation() ? 1.0f : 0.0f);
+			DynamicMaterialInstance->SetScalarParameterValue(FName("VolumePresentation"), IsVolumetric() ? 1.0f : 0.0f);
 			PlaneComponent->SetMaterial(0, DynamicMaterialInstance);
 		}
 	}
 
 	// Ensure the plane does not cast shadows
 	PlaneComponent->SetCastShadow(false);
+
+	if (UFluidSimSubsystem* Subsystem = GetWorld()->GetSubsystem<UFluidSimSubsystem>())
+	{
+		Subsystem->RegisterGrid(this);
+	}
+}
+
+void AFluidGrid::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (UFluidSimSubsystem* Subsystem = GetWorld()->GetSubsystem<UFluidSimSubsystem>())
+	{
+		Subsystem->UnregisterGrid(this);
+	}
+
+	// The task reads and writes this actor's fields, so it has to finish before they go away
+	SimulationTask.Wait();
+
+	// Pending render commands hold their own reference, so the buffers outlive this actor until they run
+	GPUSimulation.Reset();
+
+	Super::EndPlay(EndPlayReason);
 }
 
 void AFluidGrid::Tick(float DeltaSeconds)
 {
 	Super::Tick(DeltaSeconds);
 
+	// UFluidSimSubsystem steps batched grids together with the rest of the world's grids
+	if (IsBatched())
+	{
+		return;
+	}
+
+	const int32 NumSteps = BeginFrame(DeltaSeconds);
+	const double StartTime = FPlatformTime::Seconds();
+
+	if (IsVolumetric())
+	{
+		TickVolume(NumSteps);
+	}
+	else if (UsesGPUBackend())
+	{
+		TickGPU(NumSteps);
+	}
+	else if (UsesAsyncSimulation())
+	{
+		TickAsync(NumSteps);
+	}
+	else
+	{
+		TickSync(NumSteps);
+	}
+
+	// Async steps cost the task its own time on top of what the game thread spent presenting them
+	SimulationMilliseconds = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+	if (UsesAsyncSimulation())
+	{
+		SimulationMilliseconds += AsyncStepMilliseconds.load(std::memory_order_relaxed);
+	}
+}
+
+void AFluidGrid::TickSync(int32 NumSteps)
+{
+	PrepareSyncSteps();
+
+	TArray<FFluidDensityUpload> Uploads;
+	if (RunSyncSteps(NumSteps, Uploads.AddDefaulted_GetRef()))
+	{
+		SubmitDensityUploads(MoveTemp(Uploads));
+	}
+	RenderVelocity();
+}
+
+void AFluidGrid::PrepareSyncSteps()
+{
+	SimulationTask.Wait();
+
 	HandleInput();
+	ApplyLoggedParameters();
+	Solver.Settings = MakeSolverSettings();
+	Solver.AllocateFields();
+	BuildPaletteLUT();
+	UpdatePaletteTexture();
+	AcquireStagingSlot();
+	StepTime = GetWorld()->GetTimeSeconds();
+}
 
-	int32 cx = Size / 2;
-	int32 cy = Size / 2;
+bool AFluidGrid::RunSyncSteps(int32 NumSteps, FFluidDensityUpload& OutUpload)
+{
+	const int32 NumCells = Solver.GetSize() * Solver.GetSize();
+	const bool bInterpolate = bFixedTimestep && bInterpolateDensity;
+	for (int32 Step = 0; Step < NumSteps; Step++)
+	{
+		if (bInterpolate && Step == NumSteps - 1)
+		{
+			PreviousDensity.SetNumUninitialized(NumCells, EAllowShrinking::No);
+			FMemory::Memcpy(PreviousDensity.GetData(), Solver.GetDensity(), NumCells * sizeof(float));
+		}
 
-	// Add multiple affected areas
-	for (int32 offset = -Size / 4; offset <= Size / 4; offset += Size / 4)
+		if (bDeterministic)
+		{
+			// Time is summed one step at a time, and the inputs come from the log, so every machine sees the
+			// same ones. Summing keeps the turbulence phase continuous when a logged change moves SimRate.
+			StepTime = (float)DeterministicTime;
+			DeterministicTime += 1.0 / SimRate;
+			GatherLoggedStrokes(SimStep + 1, StepBrushStrokes);
+		}
+		else
+		{
+			TakeBrushStrokes(StepBrushStrokes);
+		}
+
+		Solver.ApplyBrushStrokes(StepBrushStrokes);
+		Solver.InjectSources(StepTime);
+		Solver.StepSimulation();
+		Solver.FadeDensity();
+		SimStep++;
+	}
+
+	if (bDeterministic && HasAuthority())
 	{
-		for (int32 i = -AreaSize; i <= AreaSize; i++)
+		AuthorityStep = SimStep;
+	}
+
+	if (bInterpolate && PreviousDensity.Num() == NumCells)
+	{
+		// Present one step behind, blended by how far the accumulator is into the next step
+		const float Alpha = StepAccumulator * SimRate;
+		const float* Current = Solver.GetDensity();
+		InterpolatedDensity.SetNumUninitialized(NumCells, EAllowShrinking::No);
+		for (int32 i = 0; i < NumCells; i++)
 		{
-			for (int32 j = -AreaSize; j <= AreaSize; j++)
-			{
-				AddDensity(cx + i + offset, cy + j + offset, AffectedDensity);
-			}
+			InterpolatedDensity[i] = FMath::Lerp(PreviousDensity[i], Current[i], Alpha);
+		}
+		return BuildDensityUpload(InterpolatedDensity.GetData(), nullptr, OutUpload);
+	}
+	if (NumSteps > 0)
+	{
+		return BuildDensityUpload(Solver.GetDensity(), bSparseTiles ? &Solver.GetDensityTiles() : nullptr, OutUpload);
+	}
+	return false;
+}
+
+int32 AFluidGrid::BeginFrame(float DeltaSeconds)
+{
+	// Size may have been changed without going through SetResolution. The solver follows Size on its own
+	// in AllocateFields, so the render target is what tells.
+	if (RenderTarget->SizeX != Size)
+	{
+		ResizeGrid(Size);
+	}
+
+	// Likewise for PresentationMode, bSmoothPresentation and the backend against the render target. The
+	// GPU backend writes it through a UAV, which the texture only has if it was created with one.
+	if (RenderTarget->RenderTargetFormat != GetPresentationFormat() || RenderTarget->Filter != GetPresentationFilter()
+		|| RenderTarget->bCanCreateUAV != UsesGPUBackend())
+	{
+		ApplyPresentationMode();
+	}
+
+	// The first step waits for the startup snapshot, so the grid opens on its state rather than an empty one
+	if (LoadingSnapshot)
+	{
+		if (!SnapshotLoadTask.IsCompleted())
+		{
+			return 0;
 		}
+		FinishStartupSnapshotLoad();
 	}
 
-	float time = GetWorld()->GetTimeSeconds();
-	for (int32 i = -Size / 2; i <= Size / 2; i++)
+	const int32 NumSteps = ConsumeFixedSteps(DeltaSeconds);
+	return bDeterministic ? ClampDeterministicSteps(NumSteps) : NumSteps;
+}
+
+bool AFluidGrid::IsBatched() const
+{
+	return bUseSimulationSubsystem && !UsesGPUBackend() && !UsesAsyncSimulation() && !IsVolumetric() && HasActorBegunPlay();
+}
+
+int32 AFluidGrid::BeginBatchedFrame(float DeltaSeconds, const FVector* ViewLocation)
+{
+	// Too far from the view: sleep, and let the skipped time go. A deterministic grid never sleeps or
+	// throttles: a client that fell behind the authority's log retention could never catch up.
+	if (!bDeterministic && ViewLocation && SleepDistance > 0.0f && FVector::DistSquared(*ViewLocation, GetActorLocation()) > FMath::Square(SleepDistance))
+	{
+		ThrottledSeconds = 0.0f;
+		ThrottledFrames = 0;
+		SimulationMilliseconds = 0.0f;
+		return INDEX_NONE;
+	}
+
+	// Offscreen: only every OffscreenFrameInterval-th frame steps, with the time of the skipped ones. A
+	// world with no viewport (a dedicated server, a headless run) renders nothing, so nothing there counts
+	// as offscreen.
+	const bool bWorldRenders = GetNetMode() != NM_DedicatedServer && GetWorld()->GetGameViewport() != nullptr;
+	if (!bDeterministic && bWorldRenders && OffscreenFrameInterval > 1 && !PlaneComponent->WasRecentlyRendered(0.25f))
 	{
-		for (int32 j = -Size / 2; j <= Size / 2; j++)
+		ThrottledSeconds += DeltaSeconds;
+		if (++ThrottledFrames < OffscreenFrameInterval)
 		{
-			float noiseValueX = FMath::PerlinNoise2D(FVector2D((i + cx) * TurbulenceScale, (j + cy) * TurbulenceScale) + FVector2D(time * TurbulenceSpeed, 0.0f));
-			float noiseValueY = FMath::PerlinNoise2D(FVector2D((i + cx) * TurbulenceScale, (j + cy) * TurbulenceScale) + FVector2D(0.0f, time * TurbulenceSpeed));
-			float vx = (noiseValueX * 2.0f - 1.0f) * (AffectedVelocity * 1.2f);
-			float vy = (noiseValueY * 2.0f - 1.0f) * (AffectedVelocity * 1.2f);
-			AddVelocity(cx + i, cy + j, vx, vy);
+			SimulationMilliseconds = 0.0f;
+			return INDEX_NONE;
 		}
+		DeltaSeconds = ThrottledSeconds;
 	}
+	ThrottledSeconds = 0.0f;
+	ThrottledFrames = 0;
 
-	StepSimulation();
-	FadeDensity();
-	UpdateRenderTarget();
-	RenderDensity();
+	const double StartTime = FPlatformTime::Seconds();
+	const int32 NumSteps = BeginFrame(DeltaSeconds);
+	PrepareSyncSteps();
 	RenderVelocity();
+	SimulationMilliseconds = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+	return NumSteps;
 }
 
-void AFluidGrid::HandleInput()
+bool AFluidGrid::RunBatchedFrame(int32 NumSteps, FFluidDensityUpload& OutUpload)
 {
-	if (GetWorld()->GetFirstPlayerController()->IsInputKeyDown(EKeys::LeftMouseButton))
+	const double StartTime = FPlatformTime::Seconds();
+	const bool bUpload = RunSyncSteps(NumSteps, OutUpload);
+	SimulationMilliseconds += (FPlatformTime::Seconds() - StartTime) * 1000.0;
+	return bUpload;
+}
+
+int32 AFluidGrid::ConsumeFixedSteps(float DeltaSeconds)
+{
+	// Deterministic mode always steps at SimRate, so step counts never depend on the frame rate
+	if (!bFixedTimestep && !bDeterministic)
 	{
-		LineTraceAndColor();
+		return 1;
 	}
+
+	const float StepInterval = 1.0f / SimRate;
+	StepAccumulator += DeltaSeconds;
+	const int32 NumSteps = FMath::Min(FMath::FloorToInt(StepAccumulator / StepInterval), MaxSubsteps);
+	StepAccumulator -= NumSteps * StepInterval;
+
+	// Whatever is left past MaxSubsteps is dropped. Carrying it over would make every following frame
+	// run the cap too, and fall further behind.
+	if (StepAccumulator >= StepInterval)
+	{
+		StepAccumulator = FMath::Fmod(StepAccumulator, StepInterval);
+	}
+	return NumSteps;
 }
 
-void AFluidGrid::RenderDensity()
+void AFluidGrid::TickAsync(int32 NumSteps)
 {
-	TArray<FColor> ColorData;
-	ColorData.SetNum(Size * Size);
+	// Only the game thread touches the queue's producer side and the triple buffer's read side.
+	// Everything the solver owns is left to the task.
+	HandleInput();
 
-	for (int32 y = 0; y < Size; y++)
+	if (!PendingBrushStrokes.IsEmpty())
 	{
-		for (int32 x = 0; x < Size; x++)
+		FFluidSimInput StrokeInput;
+		StrokeInput.Type = FFluidSimInput::EType::BrushStrokes;
+		TakeBrushStrokes(StrokeInput.BrushStrokes);
+		PendingInputs.Enqueue(MoveTemp(StrokeInput));
+	}
+
+	if (NumSteps > 0)
+	{
+		FFluidSimInput FrameInput;
+		FrameInput.Type = FFluidSimInput::EType::Frame;
+		FrameInput.Time = GetWorld()->GetTimeSeconds();
+		FrameInput.NumSteps = NumSteps;
+		PendingInputs.Enqueue(FrameInput);
+	}
+
+	if (SimulationTask.IsCompleted())
+	{
+		// Outside fixed-timestep mode, frames queued while the task was busy collapse into one step
+		SimulationTask = UE::Tasks::Launch(UE_SOURCE_LOCATION, [this, Settings = MakeSolverSettings(), MaxSteps = bFixedTimestep ? MaxSubsteps : 1]()
 		{
-			float d = Density[IX(x, y)];
-			float intensity = FMath::Clamp(d / 255.0f, 0.0f, 1.0f);
+			RunAsyncStep(Settings, MaxSteps);
+		});
+	}
+
+	if (DensityFrames.IsDirty())
+	{
+		DensityFrames.SwapReadBuffers();
+	}
 
-			FColor color = (intensity == 0.0f) ? FColor::Black : GetSmoothGradientColor(intensity);
+	const TArray<float>& Frame = DensityFrames.Read();
+	if (Frame.Num() == Size * Size)
+	{
+		RenderDensity(Frame.GetData());
+	}
+}
 
-			ColorData[IX(x, y)] = color;
+void AFluidGrid::RunAsyncStep(const FFluidSolverSettings& Settings, int32 MaxSteps)
+{
+	const double StartTime = FPlatformTime::Seconds();
+	Solver.Settings = Settings;
+	Solver.AllocateFields();
+
+	// Apply every input queued since the last step. Brush strokes land in order; frames carry the
+	// turbulence time, so the newest one wins, and the steps they owe add up to at most MaxSteps.
+	int32 NumSteps = 0;
+	float Time = 0.0f;
+	FFluidSimInput Input;
+	while (PendingInputs.Dequeue(Input))
+	{
+		if (Input.Type == FFluidSimInput::EType::BrushStrokes)
+		{
+			Solver.ApplyBrushStrokes(Input.BrushStrokes);
+		}
+		else
+		{
+			NumSteps += Input.NumSteps;
+			Time = Input.Time;
 		}
 	}
 
-	// Use bilinear interpolation for smoothing
-	TArray<FColor> SmoothedColorData;
-	SmoothedColorData.SetNum(Size * Size);
+	NumSteps = FMath::Min(NumSteps, MaxSteps);
+	if (NumSteps == 0)
+	{
+		return;
+	}
 
-	for (int32 y = 0; y < Size; y++)
+	for (int32 Step = 0; Step < NumSteps; Step++)
 	{
-		for (int32 x = 0; x < Size; x++)
-		{
-			// Get the surrounding pixel values
-			FColor c00 = ColorData[IX(x, y)];
-			FColor c10 = (x + 1 < Size) ? ColorData[IX(x + 1, y)] : c00;
-			FColor c01 = (y + 1 < Size) ? ColorData[IX(x, y + 1)] : c00;
-			FColor c11 = (x + 1 < Size && y + 1 < Size) ? ColorData[IX(x + 1, y + 1)] : c00;
+		Solver.InjectSources(Time);
+		Solver.StepSimulation();
+		Solver.FadeDensity();
+	}
 
-			// Bilinear interpolation
-			float fx = (float)x / (Size - 1);
-			float fy = (float)y / (Size - 1);
+	const int32 NumCells = Solver.GetSize() * Solver.GetSize();
+	TArray<float>& Frame = DensityFrames.GetWriteBuffer();
+	Frame.SetNumUninitialized(NumCells);
+	FMemory::Memcpy(Frame.GetData(), Solver.GetDensity(), NumCells * sizeof(float));
+	DensityFrames.SwapWriteBuffers();
 
-			// Interpolate colors
-			FColor interpolatedColorX0 = FColor(
-				FMath::Lerp(c00.R, c10.R, fx),
-				FMath::Lerp(c00.G, c10.G, fx),
-				FMath::Lerp(c00.B, c10.B, fx),
-				FMath::Lerp(c00.A, c10.A, fx)
-			);
+	AsyncStepMilliseconds.store((FPlatformTime::Seconds() - StartTime) * 1000.0, std::memory_order_relaxed);
+}
 
-			FColor interpolatedColorX1 = FColor(
-				FMath::Lerp(c01.R, c11.R, fx),
-				FMath::Lerp(c01.G, c11.G, fx),
-				FMath::Lerp(c01.B, c11.B, fx),
-				FMath::Lerp(c01.A, c11.A, fx)
-			);
+void AFluidGrid::TickGPU(int32 NumSteps)
+{
+	HandleInput();
 
-			FColor interpolatedColor = FColor(
-				FMath::Lerp(interpolatedColorX0.R, interpolatedColorX1.R, fy),
-				FMath::Lerp(interpolatedColorX0.G, interpolatedColorX1.G, fy),
-				FMath::Lerp(interpolatedColorX0.B, interpolatedColorX1.B, fy),
-				FMath::Lerp(interpolatedColorX0.A, interpolatedColorX1.A, fy)
-			);
+	if (!GPUSimulation)
+	{
+		GPUSimulation = MakeShared<FFluidGPUSimulation, ESPMode::ThreadSafe>();
+	}
 
-			SmoothedColorData[IX(x, y)] = interpolatedColor;
-		}
+	// Each step is its own graph, and takes its share of the queued brush strokes
+	BuildPaletteLUT();
+	for (int32 Step = 0; Step < NumSteps; Step++)
+	{
+		EnqueueGPUStep();
 	}
+}
+
+void AFluidGrid::EnqueueGPUStep()
+{
+	// Same scaling as FFluidSolver2D's StepSimulation, InjectSources and ApplyBrushStrokes
+	FFluidGPUStepParams Params;
+	Params.Size = Size;
+	Params.Dt = GetStepDt() * 2.0f;
+	Params.Viscosity = Viscosity * 2.0f;
+	Params.Diffusion = Diffusion * 2.0f;
+	Params.DiffuseIterations = DiffuseIterations;
+	Params.PressureIterations = PressureIterations;
+	Params.AreaSize = AreaSize;
+	Params.AffectedDensity = AffectedDensity;
+	Params.TurbulenceScale = TurbulenceScale;
+	Params.TurbulenceOffset = GetWorld()->GetTimeSeconds() * TurbulenceSpeed;
+	Params.TurbulenceAmplitude = AffectedVelocity * 1.2f;
+	TakeBrushStrokes(StepBrushStrokes);
+	Params.BrushStrokes.Reserve(StepBrushStrokes.Num());
+	for (const FFluidBrushStroke& Stroke : StepBrushStrokes)
+	{
+		FFluidGPUBrushStroke& GPUStroke = Params.BrushStrokes.AddDefaulted_GetRef();
+		GPUStroke.Center = FVector2f(Stroke.Uv * Size - 0.5f);
+		GPUStroke.Velocity = FVector2f(Stroke.Velocity);
+		GPUStroke.Radius = FMath::Max(Stroke.Radius * Size, FFluidSolver2D::MinBrushRadiusCells);
+	}
+	Params.BrushDensity = AffectedDensity * 50.0f;
+	const FFluidFadeTerms FadeTerms = FFluidFadeTerms::Make(FadeMode, FadeRate);
+	Params.FadeScale = FadeTerms.Scale;
+	Params.FadeAmount = FadeTerms.Amount;
+	Params.FadeCutoff = FadeTerms.Cutoff;
+	Params.Palette = PaletteLUT;
 
 	FTextureRenderTargetResource* RenderTargetResource = RenderTarget->GameThread_GetRenderTargetResource();
-	int32 LocalSize = Size;
-	ENQUEUE_RENDER_COMMAND(UpdateRenderTarget)(
-		[RenderTargetResource, SmoothedColorData, LocalSize](FRHICommandListImmediate& RHICmdList)
-		{
-			FUpdateTextureRegion2D UpdateRegion(0, 0, 0, 0, LocalSize, LocalSize);
-			int32 Pitch = LocalSize * sizeof(FColor);
-			RHICmdList.UpdateTexture2D(
-				RenderTargetResource->GetRenderTargetTexture(), 0, UpdateRegion, Pitch, (uint8*)SmoothedColorData.GetData()
-			);
+	ENQUEUE_RENDER_COMMAND(FluidSimulationGPUStep)(
+		[Simulation = GPUSimulation, Params = MoveTemp(Params), RenderTargetResource](FRHICommandListImmediate& RHICmdList)
+		{
+			Simulation->Step_RenderThread(RHICmdList, Params, RenderTargetResource->GetRenderTargetTexture());
 		}
 		);
 }
 
-
-void AFluidGrid::RenderVelocity()
+void AFluidGrid::TickVolume(int32 NumSteps)
 {
-	//const float SCALE = 10.0f; // Adjusted for a larger visual effect
+	HandleInput();
+	BuildPaletteLUT();
+	UpdatePaletteTexture();
 
-	//for (int32 y = 0; y < Size; y++)
-	//{
-	//	for (int32 x = 0; x < Size; x++)
-	//	{
-	//		float vx = Vx[IX(x, y)];
-	//		float vy = Vy[IX(x, y)];
+	VolumeSolver.Settings = MakeSolverSettings();
+	VolumeSolver.Settings.Size = FMath::Clamp(VolumeSize, 16, 128);
+	VolumeSolver.AllocateFields();
+	InitializeVolumeTarget();
 
-	//		if (!(FMath::Abs(vx) < 0.1f && FMath::Abs(vy) <= 0.1f))
-	//		{
-	//			DrawDebugLine(
-	//				GetWorld(),
-	//				FVector(x * SCALE, y * SCALE, 0),
-	//				FVector((x + vx) * SCALE, (y + vy) * SCALE, 0),
-	//				FColor::White,
-	//				false, -1, 0,
-	//				1.0f
-	//			);
-	//		}
-	//	}
-	//}
-}
+	StepTime = GetWorld()->GetTimeSeconds();
+	for (int32 Step = 0; Step < NumSteps; Step++)
+	{
+		TakeBrushStrokes(StepBrushStrokes);
+		VolumeSolver.ApplyBrushStrokes(StepBrushStrokes);
+		VolumeSolver.InjectSources(StepTime);
+		VolumeSolver.StepSimulation();
+		VolumeSolver.FadeDensity();
+		SimStep++;
+	}
 
-void AFluidGrid::FadeDensity()
-{
-	for (int32 i = 0; i < Density.Num(); i++)
+	if (NumSteps > 0)
 	{
-		Density[i] = FMath::Clamp(Density[i] - 0.5f, 0.0f, 255.0f); // Increased fade rate for more dynamic simulation
+		AcquireStagingSlot();
+		TArray<FFluidDensityUpload> Uploads;
+		if (BuildVolumeUpload(Uploads.AddDefaulted_GetRef()))
+		{
+			SubmitDensityUploads(MoveTemp(Uploads));
+		}
 	}
 }
 
-void AFluidGrid::LineTraceAndColor()
+void AFluidGrid::InitializeVolumeTarget()
 {
-	FVector2D MousePosition;
-	if (GetWorld()->GetFirstPlayerController()->GetMousePosition(MousePosition.X, MousePosition.Y))
+	const int32 VolumeCells = VolumeSolver.GetSize();
+	if (VolumeTarget && VolumeTarget->SizeX == VolumeCells)
 	{
-		FVector WorldPosition, WorldDirection;
-		if (GetWorld()->GetFirstPlayerController()->DeprojectScreenPositionToWorld(MousePosition.X, MousePosition.Y, WorldPosition, WorldDirection))
+		return;
+	}
+
+	if (!VolumeTarget)
+	{
+		VolumeTarget = NewObject<UTextureRenderTargetVolume>(this);
+		if (DynamicMaterialInstance)
 		{
-			FHitResult HitResult;
-			FCollisionQueryParams Params;
+			DynamicMaterialInstance->SetTextureParameterValue(FName("DensityVolume"), VolumeTarget);
+		}
+	}
 
-			FVector EndPosition = WorldPosition + WorldDirection * 10000.0f;
-			bool bHit = GetWorld()->LineTraceSingleByChannel(HitResult, WorldPosition, EndPosition, ECC_Visibility, Params);
+	// The solver starts over whenever VolumeSize changes, so the texture comes back cleared with it
+	VolumeTarget->ClearColor = FLinearColor::Black;
+	VolumeTarget->Filter = GetPresentationFilter();
+	VolumeTarget->Init(VolumeCells, VolumeCells, VolumeCells, PF_R8);
+}
 
-			if (bHit && HitResult.Component == PlaneComponent)
+bool AFluidGrid::BuildVolumeUpload(FFluidDensityUpload& OutUpload)
+{
+	FLUIDSIM_SCOPE(ColorMap);
+
+	// The whole volume goes up every frame. Bricks the solver knows are empty are cleared rather than
+	// read, which is most of the volume for a single plume.
+	check(StagingRing && StagingRing->AcquiredSlot != INDEX_NONE);
+	const int32 VolumeCells = VolumeSolver.GetSize();
+	const FFluidTileMask& Bricks = VolumeSolver.GetDensityBricks();
+	const float* Source = VolumeSolver.GetDensity();
+	TArray<uint8>& Staging = StagingRing->Slots[StagingRing->AcquiredSlot];
+	Staging.SetNumUninitialized(VolumeCells * VolumeCells * VolumeCells, EAllowShrinking::No);
+
+	uint8* Texels = Staging.GetData();
+	for (int32 z = 0; z < VolumeCells; z++)
+	{
+		const int32 TileZ = z / FFluidTileMask::TileSize;
+		for (int32 y = 0; y < VolumeCells; y++)
+		{
+			const int32 TileY = y / FFluidTileMask::TileSize;
+			for (int32 TileX = 0; TileX < Bricks.GetNumTilesX(); TileX++)
 			{
-				FVector LocalHit = PlaneComponent->GetComponentTransform().InverseTransformPosition(HitResult.Location);
-				FVector2D GridPosition;
-				GridPosition.X = (LocalHit.X + (PlaneComponent->GetStaticMesh()->GetBounds().BoxExtent.X)) / (PlaneComponent->GetStaticMesh()->GetBounds().BoxExtent.X * 2.0f) * Size;
-				GridPosition.Y = (LocalHit.Y + (PlaneComponent->GetStaticMesh()->GetBounds().BoxExtent.Y)) / (PlaneComponent->GetStaticMesh()->GetBounds().BoxExtent.Y * 2.0f) * Size;
-
-				int32 ClampedGridX = FMath::Clamp(static_cast<int32>(GridPosition.X), 1, Size - 2);
-				int32 ClampedGridY = FMath::Clamp(static_cast<int32>(GridPosition.Y), 1, Size - 2);
-
-				int32 Radius = 4; // Increased radius for larger effect area
-				for (int32 i = -Radius; i <= Radius; i++)
+				const int32 First = VolumeSolver.IXUnchecked(TileX * FFluidTileMask::TileSize, y, z);
+				const int32 End = VolumeSolver.IXUnchecked(FMath::Min((TileX + 1) * FFluidTileMask::TileSize, VolumeCells), y, z);
+				if (!Bricks.IsTileActive(TileX, TileY, TileZ))
 				{
-					for (int32 j = -Radius; j <= Radius; j++)
-					{
-						int32 X = ClampedGridX + i;
-						int32 Y = ClampedGridY + j;
-						if (X >= 1 && X < Size - 1 && Y >= 1 && Y < Size - 1)
-						{
-							AddDensity(X, Y, AffectedDensity * 50.0f); // Increased density effect
-							AddVelocity(X, Y, AffectedVelocity * FMath::FRandRange(10.0f, 20.0f), AffectedVelocity * FMath::FRandRange(10.0f, 20.0f)); // Increased velocity with high randomness
-						}
-					}
+					FMemory::Memzero(Texels + First, End - First);
+					continue;
 				}
 
-				StepSimulation();
-				UpdateRenderTarget();
+				// Density spans [0, 255], so R8 stores it rounded, as on the plane
+				for (int32 i = First; i < End; i++)
+				{
+					Texels[i] = (uint8)FMath::Clamp(FMath::RoundToInt(Source[i]), 0, 255);
+				}
 			}
 		}
 	}
+
+	OutUpload.Target = VolumeTarget;
+	OutUpload.Size = VolumeCells;
+	OutUpload.Depth = VolumeCells;
+	OutUpload.BytesPerPixel = sizeof(uint8);
+	OutUpload.Regions.Reset();
+	OutUpload.Regions.Add(FIntRect(0, 0, VolumeCells, VolumeCells));
+	OutUpload.Ring = StagingRing;
+	OutUpload.Slot = StagingRing->AcquiredSlot;
+	return true;
 }
 
-void AFluidGrid::UpdateRenderTarget()
+void AFluidGrid::HandleInput()
 {
-	FTextureRenderTargetResource* RenderTargetResource = RenderTarget->GameThread_GetRenderTargetResource();
-	TArray<FColor> ColorData;
-	ColorData.SetNum(Size * Size);
+	FLUIDSIM_SCOPE(HandleInput);
 
-	for (int32 y = 0; y < Size; y++)
+	// A dedicated server, the usual deterministic authority, has no local player to paint with
+	const APlayerController* PlayerController = IsNetMode(NM_DedicatedServer) ? nullptr : GetWorld()->GetFirstPlayerController();
+	if (PlayerController && PlayerController->IsInputKeyDown(EKeys::LeftMouseButton))
 	{
-		for (int32 x = 0; x < Size; x++)
-		{
-			float Value = Density[IX(x, y)];
-			float Intensity = FMath::Clamp(Value, 0.0f, 1.0f);
+		LineTraceAndColor();
+	}
+	else
+	{
+		bMouseBrushDown = false;
+	}
+}
 
-			FColor Color = GetSmoothGradientColor(Intensity);
+bool AFluidGrid::QueueBrushStroke(FVector2D Uv, float Radius, FVector2D Velocity)
+{
+	if (bDeterministic)
+	{
+		return LogBrushStroke(Uv, Radius, Velocity);
+	}
 
-			ColorData[IX(x, y)] = Color;
-		}
+	if (PendingBrushStrokes.Num() >= MaxBrushStrokesPerStep * BrushStrokeBacklogSteps)
+	{
+		return false;
 	}
 
-	int32 LocalSize = Size;
-	ENQUEUE_RENDER_COMMAND(UpdateRenderTarget)(
-		[RenderTargetResource, ColorData, LocalSize](FRHICommandListImmediate& RHICmdList)
-		{
-			FUpdateTextureRegion2D UpdateRegion(0, 0, 0, 0, LocalSize, LocalSize);
-			int32 Pitch = LocalSize * sizeof(FColor);
-			RHICmdList.UpdateTexture2D(
-				RenderTargetResource->GetRenderTargetTexture(), 0, UpdateRegion, Pitch, (uint8*)ColorData.GetData()
-			);
-		}
-		);
+	FFluidBrushStroke& Stroke = PendingBrushStrokes.AddDefaulted_GetRef();
+	Stroke.Uv = Uv;
+	Stroke.Radius = Radius;
+	Stroke.Velocity = Velocity;
+	return true;
 }
 
-FColor AFluidGrid::GetSmoothGradientColor(float Intensity)
+void AFluidGrid::TakeBrushStrokes(TArray<FFluidBrushStroke>& OutStrokes)
 {
-	Intensity = FMath::Clamp(Intensity, 0.0f, 1.0f);
-
-	FVector4 Color1(75, 0, 130, 255);    // Indigo
-	FVector4 Color2(138, 43, 226, 255);  // Blue Violet
-	FVector4 Color3(75, 0, 130, 255);    // Indigo
-	FVector4 Color4(148, 0, 211, 255);   // Dark Violet
-	FVector4 Color5(255, 0, 255, 255);   // Magenta
-	FVector4 Color6(0, 255, 255, 255);   // Cyan
-	FVector4 Color7(0, 128, 128, 255);   // Teal
-	FVector4 Color8(0, 255, 127, 255);   // Spring Green
-	FVector4 Color9(255, 215, 0, 255);   // Gold
-	FVector4 Color10(255, 69, 0, 255);   // Red-Orange
-
-	FVector4 Color;
+	const int32 NumStrokes = FMath::Min(PendingBrushStrokes.Num(), MaxBrushStrokesPerStep);
+	OutStrokes.Reset();
+	OutStrokes.Append(PendingBrushStrokes.GetData(), NumStrokes);
+	PendingBrushStrokes.RemoveAt(0, NumStrokes, EAllowShrinking::No);
+}
 
-	if (Intensity < 0.1f)
+bool AFluidGrid::LogBrushStroke(FVector2D Uv, float Radius, FVector2D Velocity)
+{
+	// A client's stroke goes to the authority through the local player controller's relay, and comes back
+	// in the log like everyone else's
+	if (!HasAuthority())
 	{
-		Color = FMath::Lerp(Color1, Color2, Intensity * 10.0f);
+		const APlayerController* PlayerController = GetWorld()->GetFirstPlayerController();
+		UFluidBrushRelayComponent* Relay = PlayerController ? PlayerController->FindComponentByClass<UFluidBrushRelayComponent>() : nullptr;
+		if (!Relay)
+		{
+			return false;
+		}
+		Relay->Server_QueueBrushStroke(this, Uv, Radius, Velocity);
+		return true;
 	}
-	else if (Intensity < 0.2f)
+
+	// Strokes fill each step up to MaxBrushStrokesPerStep, as the queue does outside this mode
+	int32 Step = FMath::Max(SimStep + 1, LastStrokeStep);
+	if (Step == LastStrokeStep && StrokesAtLastStep >= MaxBrushStrokesPerStep)
 	{
-		Color = FMath::Lerp(Color2, Color3, (Intensity - 0.1f) * 10.0f);
+		Step++;
 	}
-	else if (Intensity < 0.3f)
+	if (Step > SimStep + BrushStrokeBacklogSteps)
 	{
-		Color = FMath::Lerp(Color3, Color4, (Intensity - 0.2f) * 10.0f);
+		return false;
 	}
-	else if (Intensity < 0.4f)
+
+	FFluidSimLogEntry Entry;
+	Entry.Step = Step;
+	Entry.Type = EFluidSimLogEntryType::BrushStroke;
+	Entry.U = (uint16)FMath::RoundToInt(FMath::Clamp(Uv.X, 0.0, 1.0) * 65535.0);
+	Entry.V = (uint16)FMath::RoundToInt(FMath::Clamp(Uv.Y, 0.0, 1.0) * 65535.0);
+	Entry.Radius = (uint16)FMath::RoundToInt(FMath::Clamp(Radius, 0.0f, 1.0f) * 65535.0f);
+	Entry.VelocityX = Velocity.X;
+	Entry.VelocityY = Velocity.Y;
+	if (!InsertLogEntry(Entry))
 	{
-		Color = FMath::Lerp(Color4, Color5, (Intensity - 0.3f) * 10.0f);
+		return false;
 	}
-	else if (Intensity < 0.5f)
+
+	if (Step != LastStrokeStep)
 	{
-		Color = FMath::Lerp(Color5, Color6, (Intensity - 0.4f) * 10.0f);
+		LastStrokeStep = Step;
+		StrokesAtLastStep = 0;
 	}
-	else if (Intensity < 0.6f)
+	StrokesAtLastStep++;
+	return true;
+}
+
+void AFluidGrid::LogParameterChange(EFluidSimLogEntryType Type, float Value)
+{
+	if (!HasAuthority())
 	{
-		Color = FMath::Lerp(Color6, Color7, (Intensity - 0.5f) * 10.0f);
+		return;
 	}
-	else if (Intensity < 0.7f)
+
+	// Always due at the next step: ClampDeterministicSteps has already sized this frame's steps around
+	// the entries it knew of, and the next PrepareSyncSteps applies it before any of them run
+	FFluidSimLogEntry Entry;
+	Entry.Step = SimStep + 1;
+	Entry.Type = Type;
+	Entry.Value = Value;
+	if (!InsertLogEntry(Entry))
 	{
-		Color = FMath::Lerp(Color7, Color8, (Intensity - 0.6f) * 10.0f);
+		UE_LOG(LogFluidSimulation, Warning, TEXT("%s: the input log is full, so a parameter change was dropped on every machine"), *GetPathName());
 	}
-	else if (Intensity < 0.8f)
+}
+
+bool AFluidGrid::InsertLogEntry(const FFluidSimLogEntry& Entry)
+{
+	return InputLog.Add(Entry, SimStep - InputLogRetentionSteps + 1, GetMaxInputLogEntries());
+}
+
+int32 AFluidGrid::GetMaxInputLogEntries() const
+{
+	// Every step from the oldest kept one to the end of the stroke backlog can hold a full batch of strokes
+	// and a change of each parameter, so in normal use only retention ever trims the log
+	return (MaxBrushStrokesPerStep + ParameterEntriesPerStep) * (InputLogRetentionSteps + BrushStrokeBacklogSteps);
+}
+
+bool FFluidSimInputLog::Add(FFluidSimLogEntry Entry, int32 FirstKeptStep, int32 MaxEntries)
+{
+	// The trimmed entries are a prefix of Sorted, and all of them are for steps before FirstKeptStep
+	const int32 NumTrimmed = Algo::LowerBoundBy(Sorted, FirstKeptStep, &FFluidSimLogEntry::Step);
+	if (NumTrimmed > 0)
 	{
-		Color = FMath::Lerp(Color8, Color9, (Intensity - 0.7f) * 10.0f);
+		Entries.RemoveAll([FirstKeptStep](const FFluidSimLogEntry& Kept)
+		{
+			return Kept.Step < FirstKeptStep;
+		});
+		Sorted.RemoveAt(0, NumTrimmed, EAllowShrinking::No);
+		MarkArrayDirty();
 	}
-	else if (Intensity < 0.9f)
+
+	// Dropping the new entry keeps every machine in step, since none of them ever sees it
+	if (Sorted.Num() >= MaxEntries)
 	{
-		Color = FMath::Lerp(Color9, Color10, (Intensity - 0.8f) * 10.0f);
+		return false;
 	}
-	else
+
+	Entry.Sequence = NextSequence++;
+	MarkItemDirty(Entries.Add_GetRef(Entry));
+
+	// Sequence numbers only grow, so a new entry goes after every other entry of its step
+	Sorted.Insert(Entry, Algo::UpperBoundBy(Sorted, Entry.Step, &FFluidSimLogEntry::Step));
+	return true;
+}
+
+void FFluidSimInputLog::RebuildSorted()
+{
+	Sorted = Entries;
+	Sorted.Sort([](const FFluidSimLogEntry& A, const FFluidSimLogEntry& B)
+	{
+		return A.Step != B.Step ? A.Step < B.Step : A.Sequence < B.Sequence;
+	});
+}
+
+int32 AFluidGrid::ClampDeterministicSteps(int32 NumSteps) const
+{
+	// Clients follow the authority's step count rather than their own clock, catching up at most
+	// MaxSubsteps a frame
+	if (!HasAuthority())
 	{
-		Color = FMath::Lerp(Color10, Color1, (Intensity - 0.9f) * 10.0f);
+		NumSteps = FMath::Clamp(AuthorityStep - SimStep, 0, MaxSubsteps);
 	}
 
-	return FColor(Color.X, Color.Y, Color.Z, Color.W);
+	// Parameter changes are applied between frames on the game thread, so a frame's steps stop short of
+	// the next one. One due at the very next step is applied before this frame's steps.
+	for (const FFluidSimLogEntry& Entry : InputLog.GetSorted())
+	{
+		if (Entry.Type != EFluidSimLogEntryType::BrushStroke && Entry.Step > SimStep + 1)
+		{
+			return FMath::Min(NumSteps, Entry.Step - (SimStep + 1));
+		}
+	}
+	return NumSteps;
 }
 
-void AFluidGrid::AddDensity(int32 x, int32 y, float amount)
+void AFluidGrid::ApplyLoggedParameters()
 {
-	int32 Index = IX(x, y);
-	Density[Index] += amount;
+	if (!bDeterministic)
+	{
+		return;
+	}
+
+	// Runs every frame until the step it is due at has run, so each change has to be idempotent
+	for (const FFluidSimLogEntry& Entry : InputLog.GetSorted())
+	{
+		if (Entry.Step != SimStep + 1 || Entry.Type == EFluidSimLogEntryType::BrushStroke)
+		{
+			continue;
+		}
+
+		switch (Entry.Type)
+		{
+		case EFluidSimLogEntryType::PressureIterations:
+			PressureIterations = FMath::Max(FMath::RoundToInt(Entry.Value), 1);
+			break;
+		case EFluidSimLogEntryType::VelocityResolution:
+			VelocityResolution = (EFluidVelocityResolution)FMath::RoundToInt(Entry.Value);
+			break;
+		case EFluidSimLogEntryType::SimRate:
+			SimRate = FMath::Max(Entry.Value, 1.0f);
+			break;
+		case EFluidSimLogEntryType::Resolution:
+			ResizeGrid(FMath::RoundToInt(Entry.Value));
+			break;
+		default:
+			break;
+		}
+	}
 }
 
-void AFluidGrid::AddVelocity(int32 x, int32 y, float amountX, float amountY)
+void AFluidGrid::GatherLoggedStrokes(int32 Step, TArray<FFluidBrushStroke>& OutStrokes) const
 {
-	int32 Index = IX(x, y);
-	Vx[Index] += amountX;
-	Vy[Index] += amountY;
+	OutStrokes.Reset();
+	const TConstArrayView<FFluidSimLogEntry> Entries = InputLog.GetSorted();
+	for (int32 Index = Algo::LowerBoundBy(Entries, Step, &FFluidSimLogEntry::Step); Index < Entries.Num() && Entries[Index].Step == Step; Index++)
+	{
+		if (Entries[Index].Type == EFluidSimLogEntryType::BrushStroke)
+		{
+			OutStrokes.Add(Entries[Index].ToBrushStroke());
+		}
+	}
 }
 
-void AFluidGrid::StepSimulation()
+bool AFluidGrid::SaveSnapshot(const FString& FilePath)
 {
-	TArray<float> Vx0 = Vx;
-	TArray<float> Vy0 = Vy;
-	TArray<float> Density0 = Density;
+	if (!HasActorBegunPlay() || UsesGPUBackend() || IsVolumetric())
+	{
+		UE_LOG(LogFluidSimulation, Warning, TEXT("%s: snapshots need a playing 2D grid on the CPU backend"), *GetPathName());
+		return false;
+	}
 
-	float AdjustedViscosity = Viscosity * 2.0f;
-	float AdjustedDiffusion = Diffusion * 2.0f;
-	float AdjustedDt = Dt * 2.0f;
+	// The async task owns the solver while it runs
+	SimulationTask.Wait();
 
-	Diffuse(1, Vx, Vx0, AdjustedViscosity, AdjustedDt);
-	Diffuse(2, Vy, Vy0, AdjustedViscosity, AdjustedDt);
+	FFluidSnapshot Snapshot;
+	Solver.CaptureSnapshot(Snapshot);
+	const FString Path = FFluidSnapshot::ResolvePath(FilePath);
+	if (!Snapshot.SaveToFile(Path, bCompressSnapshots))
+	{
+		UE_LOG(LogFluidSimulation, Error, TEXT("%s: could not write the snapshot %s"), *GetPathName(), *Path);
+		return false;
+	}
+	return true;
+}
 
-	Project(Vx, Vy, Vx0, Vy0);
+bool AFluidGrid::LoadSnapshot(const FString& FilePath)
+{
+	if (!HasActorBegunPlay() || UsesGPUBackend() || IsVolumetric())
+	{
+		UE_LOG(LogFluidSimulation, Warning, TEXT("%s: snapshots need a playing 2D grid on the CPU backend"), *GetPathName());
+		return false;
+	}
+	if (bDeterministic)
+	{
+		UE_LOG(LogFluidSimulation, Warning, TEXT("%s: deterministic grids only load StartupSnapshot"), *GetPathName());
+		return false;
+	}
 
-	Advect(1, Vx, Vx0, Vx0, Vy0, AdjustedDt);
-	Advect(2, Vy, Vy0, Vx0, Vy0, AdjustedDt);
+	FFluidSnapshot Snapshot;
+	const FString Path = FFluidSnapshot::ResolvePath(FilePath);
+	if (!Snapshot.LoadFromFile(Path))
+	{
+		UE_LOG(LogFluidSimulation, Error, TEXT("%s: could not load the snapshot %s"), *GetPathName(), *Path);
+		return false;
+	}
 
-	Project(Vx, Vy, Vx0, Vy0);
+	// A startup snapshot still on its way in would overwrite this one
+	if (LoadingSnapshot)
+	{
+		SnapshotLoadTask.Wait();
+		LoadingSnapshot.Reset();
+	}
+	ApplySnapshot(Snapshot);
+	return true;
+}
 
-	Diffuse(0, Density, Density0, AdjustedDiffusion, AdjustedDt);
+void AFluidGrid::BeginStartupSnapshotLoad()
+{
+	if (StartupSnapshot.IsEmpty())
+	{
+		return;
+	}
+	if (UsesGPUBackend() || IsVolumetric())
+	{
+		UE_LOG(LogFluidSimulation, Warning, TEXT("%s: StartupSnapshot is ignored on the GPU backend and in volume mode"), *GetPathName());
+		return;
+	}
 
-	Advect(0, Density, Density0, Vx, Vy, AdjustedDt);
+	// The task only touches the snapshot it shares with the actor, so it can outlive EndPlay
+	LoadingSnapshot = MakeShared<FFluidSnapshot, ESPMode::ThreadSafe>();
+	SnapshotLoadTask = UE::Tasks::Launch(UE_SOURCE_LOCATION, [Snapshot = LoadingSnapshot, Path = FFluidSnapshot::ResolvePath(StartupSnapshot)]()
+	{
+		return Snapshot->LoadFromFile(Path);
+	});
+}
 
-	SetBoundary(0, Density);
-	SetBoundary(1, Vx);
-	SetBoundary(2, Vy);
+void AFluidGrid::FinishStartupSnapshotLoad()
+{
+	if (SnapshotLoadTask.GetResult())
+	{
+		ApplySnapshot(*LoadingSnapshot);
+	}
+	else
+	{
+		UE_LOG(LogFluidSimulation, Error, TEXT("%s: could not load the startup snapshot %s"), *GetPathName(), *FFluidSnapshot::ResolvePath(StartupSnapshot));
+	}
+	LoadingSnapshot.Reset();
 }
 
-void AFluidGrid::AddRandomCentralVelocity(float magnitude)
+void AFluidGrid::ApplySnapshot(const FFluidSnapshot& Snapshot)
 {
-	int32 centerX = Size / 2;
-	int32 centerY = Size / 2;
+	SimulationTask.Wait();
 
-	float randomAngle = FMath::RandRange(0.0f, 2.0f * PI);
-	float velocityX = magnitude * FMath::Cos(randomAngle);
-	float velocityY = magnitude * FMath::Sin(randomAngle);
+	// Restore into the grids the next step will use, so nothing is resampled twice
+	Solver.Settings = MakeSolverSettings();
+	Solver.AllocateFields();
+	Solver.RestoreSnapshot(Snapshot);
 
-	AddVelocity(centerX, centerY, velocityX, velocityY);
+	// Whatever was presented or kept for presentation shows the old state
+	PresentedTiles = FFluidTileMask();
+	PreviousDensity.Reset();
 }
 
-void AFluidGrid::Diffuse(int32 b, TArray<float>& x, TArray<float>& x0, float diff, float dt)
+void AFluidGrid::RenderDensity(const float* Source, const FFluidTileMask* ActiveTiles)
 {
-	float a = dt * diff * (Size - 2) * (Size - 2);
-	LinearSolve(b, x, x0, a, 1 + 4 * a);
+	BuildPaletteLUT();
+	UpdatePaletteTexture();
+	AcquireStagingSlot();
+
+	TArray<FFluidDensityUpload> Uploads;
+	if (BuildDensityUpload(Source, ActiveTiles, Uploads.AddDefaulted_GetRef()))
+	{
+		SubmitDensityUploads(MoveTemp(Uploads));
+	}
 }
 
-void AFluidGrid::Advect(int32 b, TArray<float>& d, TArray<float>& d0, TArray<float>& velocX, TArray<float>& velocY, float dt)
+void AFluidGrid::AcquireStagingSlot()
 {
-	float dtx = dt * (Size - 2);
-	float dty = dt * (Size - 2);
-	float Nfloat = Size - 2;
-	int32 i, j;
+	if (!StagingRing || StagingRing->Slots.Num() != NumStagingBuffers)
+	{
+		// Commands still in flight keep the old ring alive until they are done with it
+		StagingRing = MakeShared<FFluidStagingRing, ESPMode::ThreadSafe>();
+		StagingRing->Init(FMath::Clamp(NumStagingBuffers, 2, 8));
+		NumStagingBuffers = StagingRing->Slots.Num();
+	}
+
+	// Kept until an upload from it is submitted; a frame with nothing to upload leaves it for the next
+	if (StagingRing->AcquiredSlot != INDEX_NONE)
+	{
+		return;
+	}
 
-	for (j = 1; j < Size - 1; j++)
+	// The render thread may still be reading this slot from NumStagingBuffers frames ago
+	const int32 Slot = StagingRing->NextSlot;
+	if (!StagingRing->Fences[Slot].IsFenceComplete())
 	{
-		for (i = 1; i < Size - 1; i++)
+		FLUIDSIM_SCOPE(StagingWait);
+		StagingRing->Fences[Slot].Wait();
+	}
+	StagingRing->AcquiredSlot = Slot;
+}
+
+bool AFluidGrid::BuildDensityUpload(const float* Source, const FFluidTileMask* ActiveTiles, FFluidDensityUpload& OutUpload)
+{
+	FLUIDSIM_SCOPE(ColorMap);
+
+	// The single upload of the frame. The texels go straight into the staging slot that AcquireStagingSlot
+	// reserved on the game thread, and the render command reads them from there. Touches nothing but this
+	// actor's presentation state, so UFluidSimSubsystem runs it on workers.
+	check(StagingRing && StagingRing->AcquiredSlot != INDEX_NONE);
+	const bool bDensityTexels = UsesDensityPresentation();
+
+	// With an activity mask only tiles that hold density now, or did at the last present, can differ from
+	// the texture. Each texel depends on its own cell alone, so no halo is needed.
+	TArray<FIntRect> Regions;
+	if (ActiveTiles && ActiveTiles->GetGridSize() == Size && PresentedTiles.GetGridSize() == Size)
+	{
+		DirtyTiles = *ActiveTiles;
+		DirtyTiles.Union(PresentedTiles);
+
+		if (DirtyTiles.CountActive() == DirtyTiles.GetNumTilesX() * DirtyTiles.GetNumTilesY())
+		{
+			Regions.Add(FIntRect(0, 0, Size, Size));
+		}
+		else
 		{
-			float x = i - dtx * velocX[IX(i, j)];
-			float y = j - dty * velocY[IX(i, j)];
+			// One rectangle per run of dirty tiles along each tile row
+			for (int32 TileY = 0; TileY < DirtyTiles.GetNumTilesY(); TileY++)
+			{
+				for (int32 TileX = 0; TileX < DirtyTiles.GetNumTilesX(); TileX++)
+				{
+					if (!DirtyTiles.IsTileActive(TileX, TileY))
+					{
+						continue;
+					}
 
-			x = FMath::Clamp(x, 0.5f, Nfloat + 0.5f);
-			y = FMath::Clamp(y, 0.5f, Nfloat + 0.5f);
+					const int32 FirstTile = TileX;
+					while (TileX + 1 < DirtyTiles.GetNumTilesX() && DirtyTiles.IsTileActive(TileX + 1, TileY))
+					{
+						TileX++;
+					}
+					Regions.Add(FIntRect(
+						FirstTile * FFluidTileMask::TileSize,
+						TileY * FFluidTileMask::TileSize,
+						FMath::Min((TileX + 1) * FFluidTileMask::TileSize, Size),
+						FMath::Min((TileY + 1) * FFluidTileMask::TileSize, Size)));
+				}
+			}
+		}
+	}
+	else
+	{
+		Regions.Add(FIntRect(0, 0, Size, Size));
+	}
 
-			int32 i0 = FMath::FloorToInt(x);
-			int32 i1 = i0 + 1;
-			int32 j0 = FMath::FloorToInt(y);
-			int32 j1 = j0 + 1;
+	if (ActiveTiles && ActiveTiles->GetGridSize() == Size)
+	{
+		PresentedTiles = *ActiveTiles;
+	}
+	else
+	{
+		PresentedTiles.Init(Size, true);
+	}
+
+	if (Regions.IsEmpty())
+	{
+		return false;
+	}
 
-			float s1 = x - i0;
-			float s0 = 1.0f - s1;
-			float t1 = y - j0;
-			float t0 = 1.0f - t1;
+	const int32 BytesPerPixel = !bDensityTexels ? sizeof(FColor)
+		: PresentationMode == EFluidPresentationMode::DensityR16F ? sizeof(FFloat16) : sizeof(uint8);
+	TArray<uint8>& Staging = StagingRing->Slots[StagingRing->AcquiredSlot];
+	Staging.SetNumUninitialized(Size * Size * BytesPerPixel, EAllowShrinking::No);
 
-			d[IX(i, j)] = s0 * (t0 * d0[IX(i0, j0)] + t1 * d0[IX(i0, j1)]) + s1 * (t0 * d0[IX(i1, j0)] + t1 * d0[IX(i1, j1)]);
+	if (PresentationMode == EFluidPresentationMode::DensityR16F && bDensityTexels)
+	{
+		// Normalized density; the material maps it through PaletteTexture
+		FFloat16* Texels = (FFloat16*)Staging.GetData();
+		for (const FIntRect& Region : Regions)
+		{
+			for (int32 y = Region.Min.Y; y < Region.Max.Y; y++)
+			{
+				for (int32 x = Region.Min.X; x < Region.Max.X; x++)
+				{
+					Texels[IXUnchecked(x, y)] = FFloat16(FMath::Clamp(Source[IXUnchecked(x, y)] / 255.0f, 0.0f, 1.0f));
+				}
+			}
+		}
+	}
+	else if (bDensityTexels)
+	{
+		// Density already spans [0, 255], so R8 stores it rounded
+		uint8* Texels = Staging.GetData();
+		for (const FIntRect& Region : Regions)
+		{
+			for (int32 y = Region.Min.Y; y < Region.Max.Y; y++)
+			{
+				for (int32 x = Region.Min.X; x < Region.Max.X; x++)
+				{
+					Texels[IXUnchecked(x, y)] = (uint8)FMath::Clamp(FMath::RoundToInt(Source[IXUnchecked(x, y)]), 0, 255);
+				}
+			}
+		}
+	}
+	else
+	{
+		// Nearest palette entry per cell. The texture's bilinear sampler does the smoothing on the GPU.
+		FColor* Texels = (FColor*)Staging.GetData();
+		for (const FIntRect& Region : Regions)
+		{
+			for (int32 y = Region.Min.Y; y < Region.Max.Y; y++)
+			{
+				for (int32 x = Region.Min.X; x < Region.Max.X; x++)
+				{
+					const float Intensity = FMath::Clamp(Source[IXUnchecked(x, y)] / 255.0f, 0.0f, 1.0f);
+					Texels[IXUnchecked(x, y)] = (Intensity == 0.0f) ? FColor::Black : GetSmoothGradientColor(Intensity);
+				}
+			}
 		}
 	}
 
-	SetBoundary(b, d);
+	OutUpload.Target = RenderTarget;
+	OutUpload.Size = Size;
+	OutUpload.BytesPerPixel = BytesPerPixel;
+	OutUpload.Regions = MoveTemp(Regions);
+	OutUpload.Ring = StagingRing;
+	OutUpload.Slot = StagingRing->AcquiredSlot;
+	return true;
 }
 
-void AFluidGrid::Project(TArray<float>& velocX, TArray<float>& velocY, TArray<float>& p, TArray<float>& div)
+void AFluidGrid::SubmitDensityUploads(TArray<FFluidDensityUpload>&& Uploads)
 {
-	for (int32 j = 1; j < Size - 1; j++)
+	// The slots are handed to the render thread here and come back once their fences pass
+	TArray<TPair<FFluidStagingRing*, int32>, TInlineAllocator<8>> SubmittedSlots;
+	for (FFluidDensityUpload& Upload : Uploads)
 	{
-		for (int32 i = 1; i < Size - 1; i++)
+		Upload.Resource = Upload.Target ? Upload.Target->GameThread_GetRenderTargetResource() : nullptr;
+		if (Upload.Ring)
 		{
-			div[IX(i, j)] = (-0.5f * (velocX[IX(i + 1, j)] - velocX[IX(i - 1, j)] + velocY[IX(i, j + 1)] - velocY[IX(i, j - 1)])) / Size;
-			p[IX(i, j)] = 0;
+			Upload.Ring->AcquiredSlot = INDEX_NONE;
+			Upload.Ring->NextSlot = (Upload.Slot + 1) % Upload.Ring->Slots.Num();
+			SubmittedSlots.Emplace(Upload.Ring.Get(), Upload.Slot);
 		}
 	}
 
-	SetBoundary(0, div);
-	SetBoundary(0, p);
-	LinearSolve(0, p, div, 1, 6);
-
-	for (int32 j = 1; j < Size - 1; j++)
-	{
-		for (int32 i = 1; i < Size - 1; i++)
+	// One render command for every upload in the batch
+	ENQUEUE_RENDER_COMMAND(UploadFluidDensity)(
+		[Uploads = MoveTemp(Uploads)](FRHICommandListImmediate& RHICmdList) mutable
 		{
-			velocX[IX(i, j)] -= 0.5f * (p[IX(i + 1, j)] - p[IX(i - 1, j)]) * Size;
-			velocY[IX(i, j)] -= 0.5f * (p[IX(i, j + 1)] - p[IX(i, j - 1)]) * Size;
+			FLUIDSIM_SCOPE(Upload);
+			for (FFluidDensityUpload& Upload : Uploads)
+			{
+				if (!Upload.Resource || !Upload.Ring)
+				{
+					continue;
+				}
+
+				int32 Pitch = Upload.Size * Upload.BytesPerPixel;
+				const uint8* Texels = Upload.Ring->Slots[Upload.Slot].GetData();
+				for (const FIntRect& Region : Upload.Regions)
+				{
+					// The source pointer addresses the region's first pixel inside the full-size staging slot
+					const uint8* RegionTexels = Texels + (Region.Min.X + Region.Min.Y * Upload.Size) * Upload.BytesPerPixel;
+					if (Upload.Depth > 1)
+					{
+						FUpdateTextureRegion3D UpdateRegion(Region.Min.X, Region.Min.Y, 0, 0, 0, 0, Region.Width(), Region.Height(), Upload.Depth);
+						RHICmdList.UpdateTexture3D(Upload.Resource->GetRenderTargetTexture(), 0, UpdateRegion, Pitch, Pitch * Upload.Size, RegionTexels);
+						continue;
+					}
+
+					FUpdateTextureRegion2D UpdateRegion(Region.Min.X, Region.Min.Y, 0, 0, Region.Width(), Region.Height());
+					RHICmdList.UpdateTexture2D(Upload.Resource->GetRenderTargetTexture(), 0, UpdateRegion, Pitch, RegionTexels);
+				}
+			}
 		}
+		);
+
+	// Each ring is still held by its grid, so the raw pointers are good even if the command already ran
+	for (const TPair<FFluidStagingRing*, int32>& Submitted : SubmittedSlots)
+	{
+		Submitted.Key->Fences[Submitted.Value].BeginFence();
 	}
+}
+
 
-	SetBoundary(1, velocX);
-	SetBoundary(2, velocY);
+void AFluidGrid::RenderVelocity()
+{
+	//const float SCALE = 10.0f; // Adjusted for a larger visual effect
+
+	//for (int32 y = 0; y < Size; y++)
+	//{
+	//	for (int32 x = 0; x < Size; x++)
+	//	{
+	//		float vx = Solver.GetVelocityX()[IXUnchecked(x, y)];
+	//		float vy = Solver.GetVelocityY()[IXUnchecked(x, y)];
+
+	//		if (!(FMath::Abs(vx) < 0.1f && FMath::Abs(vy) <= 0.1f))
+	//		{
+	//			DrawDebugLine(
+	//				GetWorld(),
+	//				FVector(x * SCALE, y * SCALE, 0),
+	//				FVector((x + vx) * SCALE, (y + vy) * SCALE, 0),
+	//				FColor::White,
+	//				false, -1, 0,
+	//				1.0f
+	//			);
+	//		}
+	//	}
+	//}
 }
 
-void AFluidGrid::LinearSolve(int32 b, TArray<float>& x, TArray<float>& x0, float a, float c)
+void AFluidGrid::LineTraceAndColor()
 {
-	float cRecip = 1.0f / c;
-	for (int32 t = 0; t < 20; t++)
+	APlayerController* PlayerController = IsNetMode(NM_DedicatedServer) ? nullptr : GetWorld()->GetFirstPlayerController();
+	if (!PlayerController)
 	{
-		for (int32 j = 1; j < Size - 1; j++)
+		return;
+	}
+
+	FVector2D MousePosition;
+	if (PlayerController->GetMousePosition(MousePosition.X, MousePosition.Y))
+	{
+		FVector WorldPosition, WorldDirection;
+		if (PlayerController->DeprojectScreenPositionToWorld(MousePosition.X, MousePosition.Y, WorldPosition, WorldDirection))
 		{
-			for (int32 i = 1; i < Size - 1; i++)
+			FHitResult HitResult;
+			FCollisionQueryParams Params;
+
+			FVector EndPosition = WorldPosition + WorldDirection * 10000.0f;
+			bool bHit = GetWorld()->LineTraceSingleByChannel(HitResult, WorldPosition, EndPosition, ECC_Visibility, Params);
+
+			if (bHit && HitResult.Component == PlaneComponent)
 			{
-				x[IX(i, j)] = (x0[IX(i, j)] + a * (x[IX(i + 1, j)] + x[IX(i - 1, j)] + x[IX(i, j + 1)] + x[IX(i, j - 1)])) * cRecip;
+				const FVector LocalHit = PlaneComponent->GetComponentTransform().InverseTransformPosition(HitResult.Location);
+				const FVector Extent = PlaneComponent->GetStaticMesh()->GetBounds().BoxExtent;
+				const FVector2D Uv(
+					FMath::Clamp((LocalHit.X + Extent.X) / (Extent.X * 2.0f), 0.0, 1.0),
+					FMath::Clamp((LocalHit.Y + Extent.Y) / (Extent.Y * 2.0f), 0.0, 1.0));
+
+				// Push along the drag, as hard as the old brush's average push. A press that has not
+				// moved yet pushes diagonally, as the old brush did.
+				const float Speed = AffectedVelocity * 15.0f;
+				const FVector2D Drag = bMouseBrushDown ? Uv - LastMouseUv : FVector2D::ZeroVector;
+				const FVector2D Velocity = Drag.IsNearlyZero() ? FVector2D(Speed, Speed) : Drag.GetSafeNormal() * (Speed * UE_SQRT_2);
+				LastMouseUv = Uv;
+				bMouseBrushDown = true;
+
+				// The next step splats it along with every other queued stroke
+				QueueBrushStroke(Uv, BrushRadius, Velocity);
 			}
 		}
-		SetBoundary(b, x);
 	}
 }
 
-void AFluidGrid::SetBoundary(int32 b, TArray<float>& x)
+void AFluidGrid::BuildPaletteLUT()
 {
-	for (int32 i = 1; i < Size - 1; i++)
+	if (!bPaletteDirty && PaletteLUT.Num() == PaletteLUTSize)
 	{
-		x[IX(i, 0)] = b == 2 ? -x[IX(i, 1)] : x[IX(i, 1)];
-		x[IX(i, Size - 1)] = b == 2 ? -x[IX(i, Size - 2)] : x[IX(i, Size - 2)];
+		return;
 	}
-	for (int32 j = 1; j < Size - 1; j++)
+	bPaletteDirty = false;
+	bPaletteTextureDirty = true;
+
+	PaletteLUT.SetNumUninitialized(PaletteLUTSize);
+	const int32 NumStops = PaletteStops.Num();
+	for (int32 Entry = 0; Entry < PaletteLUTSize; Entry++)
 	{
-		x[IX(0, j)] = b == 1 ? -x[IX(1, j)] : x[IX(1, j)];
-		x[IX(Size - 1, j)] = b == 1 ? -x[IX(Size - 2, j)] : x[IX(Size - 2, j)];
-	}
+		const float Intensity = (float)Entry / (PaletteLUTSize - 1);
 
-	x[IX(0, 0)] = 0.5f * (x[IX(1, 0)] + x[IX(0, 1)]);
-	x[IX(0, Size - 1)] = 0.5f * (x[IX(1, Size - 1)] + x[IX(0, Size - 2)]);
-	x[IX(Size - 1, 0)] = 0.5f * (x[IX(Size - 2, 0)] + x[IX(Size - 1, 1)]);
-	x[IX(Size - 1, Size - 1)] = 0.5f * (x[IX(Size - 2, Size - 1)] + x[IX(Size - 1, Size - 2)]);
-}
+		if (PaletteCurve)
+		{
+			PaletteLUT[Entry] = PaletteCurve->GetLinearColorValue(Intensity).ToFColor(false);
+			continue;
+		}
 
-int32 AFluidGrid::IX(int32 x, int32 y) const
-{
-	x = FMath::Clamp(x, 0, Size - 1);
-	y = FMath::Clamp(y, 0, Size - 1);
+		if (NumStops < 2)
+		{
+			PaletteLUT[Entry] = NumStops == 1 ? PaletteStops[0] : FColor::Black;
+			continue;
+		}
 
-	return x + (y * Size);
+		const float Position = Intensity * (NumStops - 1);
+		const int32 Stop = FMath::Min((int32)Position, NumStops - 2);
+		const float Alpha = Position - Stop;
+		const FColor& From = PaletteStops[Stop];
+		const FColor& To = PaletteStops[Stop + 1];
+		PaletteLUT[Entry] = FColor(
+			(uint8)FMath::Lerp((float)From.R, (float)To.R, Alpha),
+			(uint8)FMath::Lerp((float)From.G, (float)To.G, Alpha),
+			(uint8)FMath::Lerp((float)From.B, (float)To.B, Alpha),
+			(uint8)FMath::Lerp((float)From.A, (float)To.A, Alpha));
+	}
 }
+
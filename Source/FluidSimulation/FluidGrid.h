@@ -3,24 +3,265 @@
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
 #include "Engine/TextureRenderTarget2D.h"
+#include "Engine/TextureRenderTargetVolume.h"
+#include "Engine/Texture2D.h"
 #include "Materials/MaterialInstanceDynamic.h"
 #include "Components/BoxComponent.h"
+#include "Curves/CurveLinearColor.h"
+#include "FluidSolver2D.h"
+#include "FluidSolver3D.h"
+#include "FluidSimulationGPU.h"
+#include "Containers/Queue.h"
+#include "Containers/TripleBuffer.h"
+#include "Tasks/Task.h"
+#include "RenderCommandFence.h"
+#include "Net/Serialization/FastArraySerializer.h"
+#include <atomic>
 #include "FluidGrid.generated.h"
 
+UENUM()
+enum class EFluidSimulationBackend : uint8
+{
+	CPU UMETA(DisplayName = "CPU"),
+	GPU UMETA(DisplayName = "GPU Compute Shaders")
+};
+
+// Work the game thread hands to the async simulation task
+struct FFluidSimInput
+{
+	enum class EType : uint8
+	{
+		Frame,       // One simulation step at Time
+		BrushStrokes // Strokes taken from the queue this frame, splatted before the next step
+	};
+
+	EType Type = EType::Frame;
+	float Time = 0.0f;
+	int32 NumSteps = 1; // Frame only: fixed-timestep steps owed for this frame
+	TArray<FFluidBrushStroke> BrushStrokes;
+};
+
+// What an FFluidSimLogEntry does when its step comes up
+UENUM()
+enum class EFluidSimLogEntryType : uint8
+{
+	BrushStroke,
+	PressureIterations,
+	VelocityResolution,
+	SimRate,
+	Resolution
+};
+
+// One input in bDeterministic's replicated log, applied just before the step it names. Strokes are
+// quantized when they are logged, so the authority replays exactly what its clients receive: about
+// 24 bytes a stroke instead of the Size x Size field.
+USTRUCT()
+struct FFluidSimLogEntry : public FFastArraySerializerItem
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	int32 Step = 0; // Steps count from 1
+
+	UPROPERTY()
+	int32 Sequence = 0; // The authority's arrival order, which orders the entries within a step
+
+	UPROPERTY()
+	EFluidSimLogEntryType Type = EFluidSimLogEntryType::BrushStroke;
+
+	// Brush strokes: Uv and Radius in 1/65535ths of the grid, and the velocity
+	UPROPERTY()
+	uint16 U = 0;
+
+	UPROPERTY()
+	uint16 V = 0;
+
+	UPROPERTY()
+	uint16 Radius = 0;
+
+	UPROPERTY()
+	float VelocityX = 0.0f;
+
+	UPROPERTY()
+	float VelocityY = 0.0f;
+
+	// Parameter changes: the new value
+	UPROPERTY()
+	float Value = 0.0f;
+
+	FFluidBrushStroke ToBrushStroke() const
+	{
+		FFluidBrushStroke Stroke;
+		Stroke.Uv = FVector2D(U / 65535.0f, V / 65535.0f);
+		Stroke.Radius = Radius / 65535.0f;
+		Stroke.Velocity = FVector2D(VelocityX, VelocityY);
+		return Stroke;
+	}
+};
+
+// bDeterministic's input log as a fast array, so replication sends each client only the entries added
+// or trimmed since its last update rather than rediffing the whole log by index. Clients receive the
+// entries in no particular order, so everything reads them through GetSorted.
+USTRUCT()
+struct FFluidSimInputLog : public FFastArraySerializer
+{
+	GENERATED_BODY()
+
+	// Authority only: trims the entries for steps before FirstKeptStep, then appends an entry stamped with
+	// the next sequence number. Entries a peer may still replay are never trimmed, so a log already holding
+	// MaxEntries refuses the new one and returns false.
+	bool Add(FFluidSimLogEntry Entry, int32 FirstKeptStep, int32 MaxEntries);
+
+	// Ordered by step, and by arrival on the authority within a step
+	TConstArrayView<FFluidSimLogEntry> GetSorted() const { return Sorted; }
+
+	void PostReplicatedReceive(const FFastArraySerializer::FPostReplicatedReceiveParameters& Parameters) { RebuildSorted(); }
+
+	bool NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms)
+	{
+		return FFastArraySerializer::FastArrayDeltaSerialize<FFluidSimLogEntry, FFluidSimInputLog>(Entries, DeltaParms, *this);
+	}
+
+private:
+	void RebuildSorted();
+
+	UPROPERTY()
+	TArray<FFluidSimLogEntry> Entries;
+
+	TArray<FFluidSimLogEntry> Sorted;
+	int32 NextSequence = 0;
+};
+
+template<>
+struct TStructOpsTypeTraits<FFluidSimInputLog> : public TStructOpsTypeTraitsBase2<FFluidSimInputLog>
+{
+	enum
+	{
+		WithNetDeltaSerializer = true,
+	};
+};
+
+// A fixed ring of upload buffers. The texels for a frame are written straight into a slot and the render
+// command reads them from there. Each slot's fence is begun on the game thread after its upload is
+// enqueued, and a slot is only written again once its fence has passed, so nothing is copied or allocated
+// in steady state. Shared so in-flight commands can outlive the actor.
+struct FFluidStagingRing
+{
+	TArray<TArray<uint8>> Slots;        // Never resized after Init, so the render thread can index it
+	TArray<FRenderCommandFence> Fences;
+	int32 NextSlot = 0;
+	int32 AcquiredSlot = INDEX_NONE;    // Game thread: the slot the next upload writes, kept until submitted
+
+	void Init(int32 NumSlots)
+	{
+		Slots.SetNum(NumSlots);
+		Fences.SetNum(NumSlots);
+	}
+};
+
+// One grid's density texels on their way to the render thread
+struct FFluidDensityUpload
+{
+	UTextureRenderTarget* Target = nullptr;           // The plane's 2D target, or the volume target when Depth > 1
+	FTextureRenderTargetResource* Resource = nullptr; // Resolved from Target on the game thread
+	TArray<FIntRect> Regions;                         // The rectangles of the slot to upload, through every slice
+	int32 Size = 0;
+	int32 Depth = 1;
+	int32 BytesPerPixel = sizeof(FColor);
+	TSharedPtr<FFluidStagingRing, ESPMode::ThreadSafe> Ring; // The full Size x Size x Depth texels are in Ring->Slots[Slot]
+	int32 Slot = INDEX_NONE;
+};
+
 UCLASS()
 class FLUIDSIMULATION_API AFluidGrid : public AActor
 {
 	GENERATED_BODY()
 
+	friend class UFluidSimSubsystem;
+
 public:
 	AFluidGrid();
 
+#if WITH_EDITOR
+	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
+#endif
+
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
+	// Resizes the density grid (and the velocity grid with it) and the render target together, keeping
+	// the current state resampled onto the new grid. Safe to call every frame as a quality knob.
+	UFUNCTION(BlueprintCallable, Category = "Fluid Simulation")
+	void SetResolution(int32 NewSize);
+
+	UFUNCTION(BlueprintPure, Category = "Fluid Simulation")
+	int32 GetResolution() const { return Size; }
+
+	// Wall time of the last frame's simulation work for this actor: the steps and the presentation on the
+	// game thread, plus the last completed task with bAsyncSimulation. The GPU backend only reports the
+	// game-thread side.
+	UFUNCTION(BlueprintPure, Category = "Fluid Simulation")
+	float GetSimulationMilliseconds() const { return SimulationMilliseconds; }
+
+	// Runtime quality knobs; UFluidQualityGovernorComponent drives them. Each takes effect from the next step.
+	// With bDeterministic, these and SetResolution are logged on the authority and ignored on clients.
+	UFUNCTION(BlueprintCallable, Category = "Fluid Simulation|Quality")
+	void SetPressureIterations(int32 Iterations);
+
+	UFUNCTION(BlueprintPure, Category = "Fluid Simulation|Quality")
+	int32 GetPressureIterations() const { return PressureIterations; }
+
+	UFUNCTION(BlueprintCallable, Category = "Fluid Simulation|Quality")
+	void SetVelocityResolution(EFluidVelocityResolution Resolution);
+
+	UFUNCTION(BlueprintPure, Category = "Fluid Simulation|Quality")
+	EFluidVelocityResolution GetVelocityResolution() const { return VelocityResolution; }
+
+	// Only used with bFixedTimestep
+	UFUNCTION(BlueprintCallable, Category = "Fluid Simulation|Quality")
+	void SetSimRate(float Rate);
+
+	UFUNCTION(BlueprintPure, Category = "Fluid Simulation|Quality")
+	float GetSimRate() const { return SimRate; }
+
+	UFUNCTION(BlueprintPure, Category = "Fluid Simulation|Quality")
+	bool IsFixedTimestep() const { return bFixedTimestep; }
+
+	// The step rate Dt is tuned for. Fixed steps scale Dt by ReferenceSimRate / SimRate, so the fluid moves
+	// at the same speed at any rate and a lower rate only makes the motion coarser.
+	static constexpr float ReferenceSimRate = 60.0f;
+
+	// Queues a brush splat centred at Uv (0..1 across the plane) for the next step, from any game-thread
+	// source: the mouse, Blueprints, replicated input or gameplay. Radius is in Uv units and Velocity is
+	// added at the centre. Each step applies at most MaxBrushStrokesPerStep in one pass and leaves the rest
+	// for the steps after. Returns false, dropping the stroke, when the queue already holds
+	// BrushStrokeBacklogSteps steps' worth. With bDeterministic the authority logs the stroke for every
+	// machine. A client sends it there through its player controller's UFluidBrushRelayComponent, and returns
+	// false when it has none.
+	UFUNCTION(BlueprintCallable, Category = "Fluid Simulation|Brush")
+	bool QueueBrushStroke(FVector2D Uv, float Radius, FVector2D Velocity);
+
+	// Steps run since BeginPlay. With bDeterministic, equal step counts mean equal fields on every machine.
+	UFUNCTION(BlueprintPure, Category = "Fluid Simulation|Determinism")
+	int32 GetSimulationStep() const { return SimStep; }
+
+	// Writes the current density and velocity to FilePath as an FFluidSnapshot; relative paths are under
+	// Saved/FluidSnapshots. CPU backend only. Returns false if nothing was written.
+	UFUNCTION(BlueprintCallable, Category = "Fluid Simulation|Snapshot")
+	bool SaveSnapshot(const FString& FilePath);
+
+	// Replaces the current state with a saved one, resampled to this grid's resolution, reading the file
+	// on the game thread. StartupSnapshot loads on a worker instead. With bDeterministic only
+	// StartupSnapshot works, since it is the one load every machine makes before the same step.
+	UFUNCTION(BlueprintCallable, Category = "Fluid Simulation|Snapshot")
+	bool LoadSnapshot(const FString& FilePath);
+
 protected:
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 	virtual void Tick(float DeltaSeconds) override;
 
 private:
-	UPROPERTY(EditAnywhere, Category = "Fluid Simulation")
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation", meta = (ClampMin = "16", ClampMax = "2048"))
 	int32 Size = 256; // Reduced size for better performance
 
 	UPROPERTY(EditAnywhere, Category = "Fluid Simulation")
@@ -47,11 +288,200 @@ private:
 	UPROPERTY(EditAnywhere, Category = "Fluid Simulation")
 	float TurbulenceSpeed = 5.0f; // Adjusted turbulence speed
 
-	TArray<float> Density, Vx, Vy, Vz;
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Turbulence")
+	bool bUseTurbulenceTile = true; // Bilinear lookups into a shared precomputed noise tile instead of PerlinNoise2D per cell
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Turbulence", meta = (ClampMin = "1"))
+	int32 TurbulenceRefreshInterval = 1; // Steps that reuse the cached turbulence field before it is resampled
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation")
+	EFluidSimulationBackend SimulationBackend = EFluidSimulationBackend::CPU; // GPU keeps the fields on the GPU and writes the render target directly
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation")
+	bool bAsyncSimulation = false; // Step on a worker task; the game thread shows the last completed frame
+
+	// Volume runs FFluidSolver3D synchronously on the CPU and uploads its density to VolumeTarget, which
+	// BaseMaterial ray-marches. The plane's Size, backend, batching and presentation settings do not apply.
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Volume")
+	EFluidSimulationDimension Dimension = EFluidSimulationDimension::Plane;
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Volume", meta = (ClampMin = "16", ClampMax = "128", EditCondition = "Dimension == EFluidSimulationDimension::Volume"))
+	int32 VolumeSize = 64; // Cells along each edge of the volume; the cost grows with its cube
+
+	// Lockstep mode for networked games: steps at SimRate with step-indexed time and replays InputLog, so
+	// every client computes the same field. Always runs on the synchronous CPU path.
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Determinism")
+	bool bDeterministic = false;
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Determinism", meta = (ClampMin = "1", EditCondition = "bDeterministic"))
+	int32 InputLogRetentionSteps = 120; // Steps of input history kept for clients that are behind
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Snapshot")
+	FString StartupSnapshot; // Loaded on a worker at BeginPlay; the grid holds its first step until it is in
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Snapshot")
+	bool bCompressSnapshots = true; // Oodle-compress the half-float fields SaveSnapshot writes
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Batching")
+	bool bUseSimulationSubsystem = true; // Synchronous CPU grids step in UFluidSimSubsystem's batch instead of their own Tick
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Batching", meta = (ClampMin = "0.0", EditCondition = "bUseSimulationSubsystem"))
+	float SleepDistance = 0.0f; // Stop stepping beyond this distance from the player's camera; 0 never sleeps. Ignored with bDeterministic.
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Batching", meta = (ClampMin = "1", EditCondition = "bUseSimulationSubsystem"))
+	int32 OffscreenFrameInterval = 4; // While not rendered, step only one frame in this many; 1 keeps full rate. Ignored with bDeterministic and on dedicated servers and other worlds without a viewport.
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Timing")
+	bool bFixedTimestep = false; // Step at SimRate regardless of frame rate instead of once per frame
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Timing", meta = (ClampMin = "1.0", EditCondition = "bFixedTimestep"))
+	float SimRate = 60.0f; // Simulation steps per second
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Timing", meta = (ClampMin = "1", EditCondition = "bFixedTimestep"))
+	int32 MaxSubsteps = 4; // Steps one frame may run to catch up; any backlog beyond it is dropped
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Timing", meta = (EditCondition = "bFixedTimestep"))
+	bool bInterpolateDensity = false; // Present a blend of the last two steps' density (synchronous CPU mode only)
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation")
+	EFluidSolverOrdering SolverOrdering = EFluidSolverOrdering::Serial; // RedBlack is opt-in; it splits each sweep across worker threads
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Solver", meta = (ClampMin = "1", ClampMax = "32", EditCondition = "SolverOrdering == EFluidSolverOrdering::TemporalBlocked"))
+	int32 TemporalBlockSweeps = 4; // Sweeps per pass over the grid with temporal blocking
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Solver", meta = (ClampMin = "1"))
+	int32 DiffuseIterations = 20; // Sweeps per viscosity/diffusion solve
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Solver", meta = (ClampMin = "1"))
+	int32 PressureIterations = 20; // Sweeps per Gauss-Seidel pressure solve
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Solver")
+	bool bLinearSolveEarlyExit = false; // Stop LinearSolve once the residual is below LinearSolveTolerance
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Solver", meta = (ClampMin = "0.0", EditCondition = "bLinearSolveEarlyExit"))
+	float LinearSolveTolerance = 1.0e-4f; // Relative max-norm residual
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Solver", meta = (ClampMin = "1", EditCondition = "bLinearSolveEarlyExit"))
+	int32 ResidualCheckInterval = 4; // Sweeps between residual checks
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Pressure")
+	EFluidPressureSolver PressureSolverType = EFluidPressureSolver::GaussSeidel;
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Pressure", meta = (ClampMin = "0.0"))
+	float MultigridTolerance = 1.0e-3f; // Relative max-norm residual that ends the solve
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Pressure", meta = (ClampMin = "1"))
+	int32 MultigridMaxCycles = 8;
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Pressure", meta = (ClampMin = "0.0"))
+	float ConjugateGradientTolerance = 1.0e-3f; // Relative max-norm residual that ends the solve
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Pressure", meta = (ClampMin = "1"))
+	int32 ConjugateGradientMaxIterations = 32;
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Pressure")
+	bool bMultigridPreconditioner = true; // Otherwise conjugate gradient uses the diagonal
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Solver")
+	bool bVectorizeProject = true; // SSE/NEON kernels for the divergence and gradient passes of Project
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Solver")
+	bool bVectorizeAdvect = true; // SSE/NEON backtrace and bilinear blend in Advect
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Solver")
+	bool bSparseTiles = true; // Skip density advect, fade and upload in 16 x 16 tiles that hold no density
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Solver")
+	EFluidVelocityResolution VelocityResolution = EFluidVelocityResolution::Full; // Velocity and pressure grid; density stays at Size
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Brush", meta = (ClampMin = "0.0", ClampMax = "0.5"))
+	float BrushRadius = 0.02f; // Mouse brush radius in Uv units
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Brush", meta = (ClampMin = "1"))
+	int32 MaxBrushStrokesPerStep = 64; // Queued strokes splatted per step; the rest wait for later steps
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Fade")
+	EFluidFadeMode FadeMode = EFluidFadeMode::Linear; // Subtract FadeRate per step, or keep 1 - FadeRate of the density
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Fade", meta = (ClampMin = "0.0"))
+	float FadeRate = 0.5f; // Density units per step (Linear) or fraction per step (Exponential, 0..1)
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Fade")
+	bool bFuseFade = true; // Fade density inside the advect pass instead of a separate sweep
+
+	// Batched mode: frame time banked while throttled offscreen, and the world time the next steps use
+	float ThrottledSeconds = 0.0f;
+	int32 ThrottledFrames = 0;
+	float StepTime = 0.0f;
+
+	// Reported by GetSimulationMilliseconds. The async task publishes its own duration separately.
+	float SimulationMilliseconds = 0.0f;
+	std::atomic<float> AsyncStepMilliseconds = 0.0f;
+
+	// Fixed-timestep mode: simulated time owed but not yet stepped, and the density before the last step
+	float StepAccumulator = 0.0f;
+	TArray<float> PreviousDensity;
+	TArray<float> InterpolatedDensity;
+
+	// Brush strokes queued by QueueBrushStroke and not yet handed to a step. Only the game thread, or the
+	// batched frame's worker while the game thread waits on it, touches the queue.
+	static constexpr int32 BrushStrokeBacklogSteps = 4;
+	TArray<FFluidBrushStroke> PendingBrushStrokes;
+	TArray<FFluidBrushStroke> StepBrushStrokes;
+
+	// The mouse brush pushes along the drag, from where the cursor hit the plane last frame
+	FVector2D LastMouseUv = FVector2D::ZeroVector;
+	bool bMouseBrushDown = false;
+
+	// Deterministic mode: the inputs, and the authority's step count that clients follow. The authority
+	// trims entries older than InputLogRetentionSteps, and never keeps more than GetMaxInputLogEntries.
+	static constexpr int32 ParameterEntriesPerStep = 4;
+
+	UPROPERTY(Replicated)
+	FFluidSimInputLog InputLog;
+
+	UPROPERTY(Replicated)
+	int32 AuthorityStep = 0;
+
+	int32 SimStep = 0;
+	double DeterministicTime = 0.0; // Deterministic mode: the turbulence time of step SimStep + 1
+	int32 LastStrokeStep = 0;   // Authority: the step the newest logged stroke is for, and how many it has
+	int32 StrokesAtLastStep = 0;
+
+	// StartupSnapshot while it loads: the task maps and decodes the file into LoadingSnapshot, and
+	// BeginFrame restores it once the task is done
+	TSharedPtr<FFluidSnapshot, ESPMode::ThreadSafe> LoadingSnapshot;
+	UE::Tasks::TTask<bool> SnapshotLoadTask;
+
+	// Owns the fields and runs every step. The game thread uses it directly, or hands it to the async task.
+	FFluidSolver2D Solver;
+
+	// Volume mode's solver, stepped on the game thread. Allocates nothing until the grid is volumetric.
+	FFluidSolver3D VolumeSolver;
+
+	// Async mode: inputs flow to the task through a lock-free queue and finished density frames come
+	// back through a triple buffer, so neither side ever waits for the other
+	TQueue<FFluidSimInput, EQueueMode::Mpsc> PendingInputs;
+	TTripleBuffer<TArray<float>> DensityFrames;
+	UE::Tasks::FTask SimulationTask;
+
+	// GPU backend: the render thread owns the buffers, so it shares ownership with this actor
+	TSharedPtr<FFluidGPUSimulation, ESPMode::ThreadSafe> GPUSimulation;
+
+	// Sparse tiles: the density tiles at the last present, and scratch for the tiles to upload this frame
+	FFluidTileMask PresentedTiles;
+	FFluidTileMask DirtyTiles;
+
+	// Presentation: the ring the density texels are written into; AcquireStagingSlot (re)creates it
+	TSharedPtr<FFluidStagingRing, ESPMode::ThreadSafe> StagingRing;
 
 	UPROPERTY(VisibleAnywhere)
 	UTextureRenderTarget2D* RenderTarget;
 
+	// Volume mode: VolumeSize^3 R8 density, created on first use
+	UPROPERTY(Transient)
+	UTextureRenderTargetVolume* VolumeTarget = nullptr;
+
 	UPROPERTY(VisibleAnywhere)
 	UMaterialInstanceDynamic* DynamicMaterialInstance;
 
@@ -67,25 +497,113 @@ private:
 	UPROPERTY(EditAnywhere, Category = "Fluid Simulation")
 	float Scale = 10.0f; // Adjusted for a larger visual effect
 
+	// Evenly spaced colour stops from zero to full density. The default wraps from Red-Orange back to Indigo.
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Palette")
+	TArray<FColor> PaletteStops = {
+		FColor(75, 0, 130),    // Indigo
+		FColor(138, 43, 226),  // Blue Violet
+		FColor(75, 0, 130),    // Indigo
+		FColor(148, 0, 211),   // Dark Violet
+		FColor(255, 0, 255),   // Magenta
+		FColor(0, 255, 255),   // Cyan
+		FColor(0, 128, 128),   // Teal
+		FColor(0, 255, 127),   // Spring Green
+		FColor(255, 215, 0),   // Gold
+		FColor(255, 69, 0),    // Red-Orange
+		FColor(75, 0, 130)     // Indigo
+	};
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Palette")
+	UCurveLinearColor* PaletteCurve = nullptr; // Overrides PaletteStops when set, sampled over [0, 1]
+
+	// The density modes upload one channel and leave the palette to BaseMaterial (CPU backend only)
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Presentation")
+	EFluidPresentationMode PresentationMode = EFluidPresentationMode::Color;
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Presentation")
+	bool bSmoothPresentation = true; // Bilinear sampling of the density texture; off shows the raw cells
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Presentation", meta = (ClampMin = "2", ClampMax = "8"))
+	int32 NumStagingBuffers = 3; // Upload slots in flight; the game thread waits when the render thread is this many frames behind
+
+	// PaletteLUT as a 1024 x 1 texture for the material, in the density presentation modes
+	UPROPERTY(Transient)
+	UTexture2D* PaletteTexture = nullptr;
+	bool bPaletteTextureDirty = true;
+
+	static constexpr int32 PaletteLUTSize = 1024;
+
+	// Built from PaletteStops or PaletteCurve on first use and after they change
+	TArray<FColor> PaletteLUT;
+	bool bPaletteDirty = true;
+
 	void InitializeRenderTarget();
-	void UpdateRenderTarget();
+	void ResizeGrid(int32 NewSize);
+
+	// bDeterministic pins the grid to the synchronous CPU path, since only that path replays the log.
+	// Volume mode has a path of its own and neither replays the log nor uses the GPU or async ones.
+	bool IsVolumetric() const { return Dimension == EFluidSimulationDimension::Volume; }
+	bool UsesGPUBackend() const;
+	bool UsesAsyncSimulation() const;
+	bool LogBrushStroke(FVector2D Uv, float Radius, FVector2D Velocity);
+	void LogParameterChange(EFluidSimLogEntryType Type, float Value);
+	bool InsertLogEntry(const FFluidSimLogEntry& Entry);
+	int32 GetMaxInputLogEntries() const;
+	int32 ClampDeterministicSteps(int32 NumSteps) const;
+	void ApplyLoggedParameters();
+	void GatherLoggedStrokes(int32 Step, TArray<FFluidBrushStroke>& OutStrokes) const;
+	void BeginStartupSnapshotLoad();
+	void FinishStartupSnapshotLoad();
+	void ApplySnapshot(const FFluidSnapshot& Snapshot);
+	bool UsesDensityPresentation() const;
+	ETextureRenderTargetFormat GetPresentationFormat() const;
+	TextureFilter GetPresentationFilter() const;
+	void ApplyPresentationMode();
+	void UpdatePaletteTexture();
+	FFluidSolverSettings MakeSolverSettings() const;
+	float GetStepDt() const;
 	void HandleInput();
 	void LineTraceAndColor();
+	void TakeBrushStrokes(TArray<FFluidBrushStroke>& OutStrokes);
+	int32 BeginFrame(float DeltaSeconds);
+	int32 ConsumeFixedSteps(float DeltaSeconds);
+	void TickSync(int32 NumSteps);
 
-	void AddDensity(int32 x, int32 y, float amount);
-	void AddVelocity(int32 x, int32 y, float amountX, float amountY);
-	void Diffuse(int32 b, TArray<float>& x, TArray<float>& x0, float diff, float dt);
-	void Advect(int32 b, TArray<float>& d, TArray<float>& d0, TArray<float>& velocX, TArray<float>& velocY, float dt);
-	void Project(TArray<float>& velocX, TArray<float>& velocY, TArray<float>& p, TArray<float>& div);
-	void LinearSolve(int32 b, TArray<float>& x, TArray<float>& x0, float a, float c);
-	void SetBoundary(int32 b, TArray<float>& x);
+	// The synchronous CPU frame in two halves: game-thread setup and input, then the steps and the colour
+	// map, which only touch this actor and so can run on any thread
+	void PrepareSyncSteps();
+	bool RunSyncSteps(int32 NumSteps, FFluidDensityUpload& OutUpload);
 
-	int32 IX(int32 x, int32 y) const;
-	void StepSimulation();
-	void AddRandomCentralVelocity(float magnitude);
+	// UFluidSimSubsystem's side of the frame. BeginBatchedFrame runs on the game thread and returns
+	// INDEX_NONE when the grid sleeps this frame; RunBatchedFrame runs on a worker.
+	bool IsBatched() const;
+	int32 BeginBatchedFrame(float DeltaSeconds, const FVector* ViewLocation);
+	bool RunBatchedFrame(int32 NumSteps, FFluidDensityUpload& OutUpload);
+	void TickAsync(int32 NumSteps);
+	void RunAsyncStep(const FFluidSolverSettings& Settings, int32 MaxSteps);
+	void TickGPU(int32 NumSteps);
+	void EnqueueGPUStep();
+	void TickVolume(int32 NumSteps);
+	void InitializeVolumeTarget();
+	bool BuildVolumeUpload(FFluidDensityUpload& OutUpload);
 
-	void RenderDensity();
+	// Row-major index for the presentation loops, on the same layout as the solver's fields
+	FORCEINLINE int32 IXUnchecked(int32 x, int32 y) const
+	{
+		return x + y * Size;
+	}
+
+	// Without ActiveTiles the whole texture is uploaded; with them only tiles that can have changed are
+	void RenderDensity(const float* Source, const FFluidTileMask* ActiveTiles = nullptr);
+	void AcquireStagingSlot();
+	bool BuildDensityUpload(const float* Source, const FFluidTileMask* ActiveTiles, FFluidDensityUpload& OutUpload);
+	static void SubmitDensityUploads(TArray<FFluidDensityUpload>&& Uploads);
 	void RenderVelocity();
-	void FadeDensity();
-	FColor GetSmoothGradientColor(float Intensity);
+	void BuildPaletteLUT();
+
+	// One table load; BuildPaletteLUT must have run
+	FORCEINLINE FColor GetSmoothGradientColor(float Intensity) const
+	{
+		return PaletteLUT[FMath::Clamp((int32)(Intensity * (PaletteLUTSize - 1) + 0.5f), 0, PaletteLUTSize - 1)];
+	}
 };
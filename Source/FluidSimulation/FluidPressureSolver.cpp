@@ -0,0 +1,449 @@
+#include "FluidPressureSolver.h"
+#include "Async/ParallelFor.h"
+
+namespace
+{
+	FORCEINLINE int32 GridIndex(int32 x, int32 y, int32 Size)
+	{
+		return x + y * Size;
+	}
+
+	// Calls RowFunc(j) for every interior row, split across workers in fixed row blocks
+	template <typename RowFuncType>
+	void ParallelRows(int32 Size, RowFuncType RowFunc)
+	{
+		const int32 NumTasks = FMath::DivideAndRoundUp(Size - 2, FluidSolverRowsPerTask);
+		ParallelFor(NumTasks, [Size, &RowFunc](int32 TaskIndex)
+		{
+			const int32 FirstRow = 1 + TaskIndex * FluidSolverRowsPerTask;
+			const int32 LastRow = FMath::Min(FirstRow + FluidSolverRowsPerTask, Size - 1);
+			for (int32 j = FirstRow; j < LastRow; j++)
+			{
+				RowFunc(j);
+			}
+		});
+	}
+
+	// Row-parallel reduction. Partial results are combined in block order so sums do not depend on scheduling.
+	template <typename RowFuncType, typename CombineFuncType>
+	double ParallelRowsReduce(int32 Size, RowFuncType RowFunc, CombineFuncType CombineFunc)
+	{
+		const int32 NumTasks = FMath::DivideAndRoundUp(Size - 2, FluidSolverRowsPerTask);
+		TArray<double, TInlineAllocator<128>> Partials;
+		Partials.SetNumZeroed(NumTasks);
+		ParallelFor(NumTasks, [Size, &RowFunc, &CombineFunc, &Partials](int32 TaskIndex)
+		{
+			const int32 FirstRow = 1 + TaskIndex * FluidSolverRowsPerTask;
+			const int32 LastRow = FMath::Min(FirstRow + FluidSolverRowsPerTask, Size - 1);
+			double Partial = 0.0;
+			for (int32 j = FirstRow; j < LastRow; j++)
+			{
+				Partial = CombineFunc(Partial, RowFunc(j));
+			}
+			Partials[TaskIndex] = Partial;
+		});
+
+		double Result = 0.0;
+		for (double Partial : Partials)
+		{
+			Result = CombineFunc(Result, Partial);
+		}
+		return Result;
+	}
+
+	double CombineMax(double A, double B)
+	{
+		return FMath::Max(A, B);
+	}
+
+	double CombineSum(double A, double B)
+	{
+		return A + B;
+	}
+
+	// Same rule as AFluidGrid::SetBoundary for b = 0
+	void SetMirroredBoundary(float* x, int32 Size)
+	{
+		for (int32 i = 1; i < Size - 1; i++)
+		{
+			x[GridIndex(i, 0, Size)] = x[GridIndex(i, 1, Size)];
+			x[GridIndex(i, Size - 1, Size)] = x[GridIndex(i, Size - 2, Size)];
+		}
+		for (int32 j = 1; j < Size - 1; j++)
+		{
+			x[GridIndex(0, j, Size)] = x[GridIndex(1, j, Size)];
+			x[GridIndex(Size - 1, j, Size)] = x[GridIndex(Size - 2, j, Size)];
+		}
+
+		x[GridIndex(0, 0, Size)] = 0.5f * (x[GridIndex(1, 0, Size)] + x[GridIndex(0, 1, Size)]);
+		x[GridIndex(0, Size - 1, Size)] = 0.5f * (x[GridIndex(1, Size - 1, Size)] + x[GridIndex(0, Size - 2, Size)]);
+		x[GridIndex(Size - 1, 0, Size)] = 0.5f * (x[GridIndex(Size - 2, 0, Size)] + x[GridIndex(Size - 1, 1, Size)]);
+		x[GridIndex(Size - 1, Size - 1, Size)] = 0.5f * (x[GridIndex(Size - 2, Size - 1, Size)] + x[GridIndex(Size - 1, Size - 2, Size)]);
+	}
+
+	void RelaxColor(float* x, const float* b, int32 Size, float a, float c, int32 Color)
+	{
+		const float cRecip = 1.0f / c;
+		ParallelRows(Size, [x, b, Size, a, cRecip, Color](int32 j)
+		{
+			for (int32 i = 1 + ((j + Color + 1) & 1); i < Size - 1; i += 2)
+			{
+				const int32 Index = GridIndex(i, j, Size);
+				x[Index] = (b[Index] + a * (x[Index + 1] + x[Index - 1] + x[Index + Size] + x[Index - Size])) * cRecip;
+			}
+		});
+		SetMirroredBoundary(x, Size);
+	}
+
+	// r = b - A * x over the interior. Returns the max-norm of r.
+	float ComputeResidual(float* r, const float* x, const float* b, int32 Size, float a, float c)
+	{
+		return (float)ParallelRowsReduce(Size, [r, x, b, Size, a, c](int32 j)
+		{
+			float RowMax = 0.0f;
+			for (int32 i = 1; i < Size - 1; i++)
+			{
+				const int32 Index = GridIndex(i, j, Size);
+				r[Index] = b[Index] - (c * x[Index] - a * (x[Index + 1] + x[Index - 1] + x[Index + Size] + x[Index - Size]));
+				RowMax = FMath::Max(RowMax, FMath::Abs(r[Index]));
+			}
+			return (double)RowMax;
+		}, CombineMax);
+	}
+
+	float MaxAbsInterior(const float* x, int32 Size)
+	{
+		return (float)ParallelRowsReduce(Size, [x, Size](int32 j)
+		{
+			float RowMax = 0.0f;
+			for (int32 i = 1; i < Size - 1; i++)
+			{
+				RowMax = FMath::Max(RowMax, FMath::Abs(x[GridIndex(i, j, Size)]));
+			}
+			return (double)RowMax;
+		}, CombineMax);
+	}
+
+	double DotInterior(const float* x, const float* y, int32 Size)
+	{
+		return ParallelRowsReduce(Size, [x, y, Size](int32 j)
+		{
+			double RowSum = 0.0;
+			for (int32 i = 1; i < Size - 1; i++)
+			{
+				const int32 Index = GridIndex(i, j, Size);
+				RowSum += (double)x[Index] * (double)y[Index];
+			}
+			return RowSum;
+		}, CombineSum);
+	}
+
+	// Weight of coarse cell CoarseI in the bilinear interpolation at fine cell FineI (both 1-based interior
+	// indices). A fine cell sits a quarter of a coarse cell from its parent's centre, so it takes 3/4 of its
+	// parent and 1/4 of the neighbour on its side. Neighbours past the edge fold back onto the edge cell,
+	// which is what the mirrored ghost cells would hold.
+	FORCEINLINE float TransferWeight(int32 FineI, int32 CoarseI, int32 CoarseInterior)
+	{
+		const int32 Parent = (FineI + 1) / 2;
+		const int32 Neighbour = FMath::Clamp((FineI & 1) ? Parent - 1 : Parent + 1, 1, CoarseInterior);
+		return (Parent == CoarseI ? 0.75f : 0.0f) + (Neighbour == CoarseI ? 0.25f : 0.0f);
+	}
+
+	// Restriction is the transpose of Prolongate scaled by 1/4, which keeps the V-cycle symmetric
+	void Restrict(const float* Fine, int32 FineSize, float* Coarse, int32 CoarseSize)
+	{
+		const int32 FineInterior = FineSize - 2;
+		const int32 CoarseInterior = CoarseSize - 2;
+		ParallelRows(CoarseSize, [=](int32 J)
+		{
+			const int32 FirstJ = FMath::Max(2 * J - 2, 1);
+			const int32 LastJ = FMath::Min(2 * J + 1, FineInterior);
+			for (int32 I = 1; I < CoarseSize - 1; I++)
+			{
+				const int32 FirstI = FMath::Max(2 * I - 2, 1);
+				const int32 LastI = FMath::Min(2 * I + 1, FineInterior);
+				float Sum = 0.0f;
+				for (int32 j = FirstJ; j <= LastJ; j++)
+				{
+					const float WeightY = TransferWeight(j, J, CoarseInterior);
+					for (int32 i = FirstI; i <= LastI; i++)
+					{
+						Sum += WeightY * TransferWeight(i, I, CoarseInterior) * Fine[GridIndex(i, j, FineSize)];
+					}
+				}
+				Coarse[GridIndex(I, J, CoarseSize)] = 0.25f * Sum;
+			}
+		});
+	}
+
+	// Fine += bilinear interpolation of Coarse
+	void ProlongateAdd(const float* Coarse, int32 CoarseSize, float* Fine, int32 FineSize)
+	{
+		const int32 CoarseInterior = CoarseSize - 2;
+		ParallelRows(FineSize, [=](int32 j)
+		{
+			const int32 ParentJ = (j + 1) / 2;
+			const int32 NeighbourJ = FMath::Clamp((j & 1) ? ParentJ - 1 : ParentJ + 1, 1, CoarseInterior);
+			const float WeightParentJ = TransferWeight(j, ParentJ, CoarseInterior);
+			const float* ParentRow = Coarse + ParentJ * CoarseSize;
+			const float* NeighbourRow = Coarse + NeighbourJ * CoarseSize;
+			for (int32 i = 1; i < FineSize - 1; i++)
+			{
+				const int32 ParentI = (i + 1) / 2;
+				const int32 NeighbourI = FMath::Clamp((i & 1) ? ParentI - 1 : ParentI + 1, 1, CoarseInterior);
+				const float WeightParentI = TransferWeight(i, ParentI, CoarseInterior);
+				Fine[GridIndex(i, j, FineSize)] +=
+					WeightParentJ * (WeightParentI * ParentRow[ParentI] + (1.0f - WeightParentI) * ParentRow[NeighbourI])
+					+ (1.0f - WeightParentJ) * (WeightParentI * NeighbourRow[ParentI] + (1.0f - WeightParentI) * NeighbourRow[NeighbourI]);
+			}
+		});
+		SetMirroredBoundary(Fine, FineSize);
+	}
+
+	void ApplyOperator(float* Out, const float* x, int32 Size, float a, float c)
+	{
+		ParallelRows(Size, [Out, x, Size, a, c](int32 j)
+		{
+			for (int32 i = 1; i < Size - 1; i++)
+			{
+				const int32 Index = GridIndex(i, j, Size);
+				Out[Index] = c * x[Index] - a * (x[Index + 1] + x[Index - 1] + x[Index + Size] + x[Index - Size]);
+			}
+		});
+	}
+}
+
+// Coarsening stops once the interior is this small; the coarsest level is relaxed to convergence instead
+static constexpr int32 MultigridCoarsestInterior = 4;
+static constexpr int32 MultigridCoarsestSweeps = 16;
+
+void FFluidMultigridSolver::AllocateLevels(int32 Size, float a, float c)
+{
+	if (Levels.Num() == 0 || Levels[0].Size != Size)
+	{
+		Levels.Reset();
+
+		int32 LevelSize = Size;
+		while (true)
+		{
+			FLevel& Level = Levels.AddDefaulted_GetRef();
+			Level.Size = LevelSize;
+			Level.R.SetNumZeroed(LevelSize * LevelSize);
+			if (Levels.Num() > 1)
+			{
+				Level.OwnedX.SetNumZeroed(LevelSize * LevelSize);
+				Level.OwnedB.SetNumZeroed(LevelSize * LevelSize);
+			}
+
+			const int32 Interior = LevelSize - 2;
+			if (Interior <= MultigridCoarsestInterior)
+			{
+				break;
+			}
+			LevelSize = (Interior + 1) / 2 + 2;
+		}
+
+		for (int32 LevelIndex = 1; LevelIndex < Levels.Num(); LevelIndex++)
+		{
+			Levels[LevelIndex].X = Levels[LevelIndex].OwnedX.GetData();
+			Levels[LevelIndex].B = Levels[LevelIndex].OwnedB.GetData();
+		}
+	}
+
+	// Rediscretise on each coarse level: c*x - a*sum splits into (c - 4a) * x plus a Laplacian term that
+	// shrinks by a factor of four every time the cell spacing doubles.
+	float LevelA = a;
+	float LevelC = c;
+	for (FLevel& Level : Levels)
+	{
+		Level.a = LevelA;
+		Level.c = LevelC;
+		LevelC -= 3.0f * LevelA;
+		LevelA *= 0.25f;
+	}
+}
+
+void FFluidMultigridSolver::VCycle(int32 LevelIndex)
+{
+	FLevel& Level = Levels[LevelIndex];
+
+	if (LevelIndex == Levels.Num() - 1)
+	{
+		for (int32 Sweep = 0; Sweep < MultigridCoarsestSweeps; Sweep++)
+		{
+			RelaxColor(Level.X, Level.B, Level.Size, Level.a, Level.c, Sweep & 1);
+			RelaxColor(Level.X, Level.B, Level.Size, Level.a, Level.c, (Sweep + 1) & 1);
+		}
+		return;
+	}
+
+	for (int32 Sweep = 0; Sweep < PreSmoothSweeps; Sweep++)
+	{
+		RelaxColor(Level.X, Level.B, Level.Size, Level.a, Level.c, 0);
+		RelaxColor(Level.X, Level.B, Level.Size, Level.a, Level.c, 1);
+	}
+
+	ComputeResidual(Level.R.GetData(), Level.X, Level.B, Level.Size, Level.a, Level.c);
+
+	FLevel& Coarse = Levels[LevelIndex + 1];
+	Restrict(Level.R.GetData(), Level.Size, Coarse.OwnedB.GetData(), Coarse.Size);
+	FMemory::Memzero(Coarse.OwnedX.GetData(), Coarse.OwnedX.Num() * sizeof(float));
+
+	VCycle(LevelIndex + 1);
+
+	ProlongateAdd(Coarse.X, Coarse.Size, Level.X, Level.Size);
+
+	// Mirror the pre-smoother's colour order on the way up
+	for (int32 Sweep = 0; Sweep < PostSmoothSweeps; Sweep++)
+	{
+		RelaxColor(Level.X, Level.B, Level.Size, Level.a, Level.c, 1);
+		RelaxColor(Level.X, Level.B, Level.Size, Level.a, Level.c, 0);
+	}
+}
+
+void FFluidMultigridSolver::ApplyVCycle(float* x, const float* x0, float a, float c, int32 Size)
+{
+	AllocateLevels(Size, a, c);
+	Levels[0].X = x;
+	Levels[0].B = x0;
+
+	FMemory::Memzero(x, Size * Size * sizeof(float));
+	VCycle(0);
+}
+
+FFluidPressureSolveResult FFluidMultigridSolver::Solve(float* x, const float* x0, float a, float c, int32 Size)
+{
+	FFluidPressureSolveResult Result;
+
+	AllocateLevels(Size, a, c);
+	FLevel& Finest = Levels[0];
+	Finest.X = x;
+	Finest.B = x0;
+
+	const float RhsNorm = MaxAbsInterior(Finest.B, Size);
+	if (RhsNorm <= 0.0f)
+	{
+		return Result;
+	}
+
+	for (int32 Cycle = 0; Cycle < MaxIterations; Cycle++)
+	{
+		VCycle(0);
+		Result.Iterations = Cycle + 1;
+		Result.Residual = ComputeResidual(Finest.R.GetData(), Finest.X, Finest.B, Size, a, c) / RhsNorm;
+		if (Result.Residual <= Tolerance)
+		{
+			break;
+		}
+	}
+
+	return Result;
+}
+
+void FFluidConjugateGradientSolver::Precondition(float* z, const float* r, float a, float c, int32 Size)
+{
+	if (bMultigridPreconditioner)
+	{
+		Preconditioner.ApplyVCycle(z, r, a, c, Size);
+		return;
+	}
+
+	// Mirrored ghosts fold each wall neighbour back onto the cell itself, which lowers the diagonal there
+	ParallelRows(Size, [z, r, a, c, Size](int32 j)
+	{
+		const int32 WallRows = (j == 1 ? 1 : 0) + (j == Size - 2 ? 1 : 0);
+		for (int32 i = 1; i < Size - 1; i++)
+		{
+			const int32 WallCells = WallRows + (i == 1 ? 1 : 0) + (i == Size - 2 ? 1 : 0);
+			const int32 Index = GridIndex(i, j, Size);
+			z[Index] = r[Index] / (c - a * WallCells);
+		}
+	});
+}
+
+FFluidPressureSolveResult FFluidConjugateGradientSolver::Solve(float* x, const float* x0, float a, float c, int32 Size)
+{
+	FFluidPressureSolveResult Result;
+
+	const int32 TotalSize = Size * Size;
+	if (R.Num() != TotalSize)
+	{
+		R.SetNumZeroed(TotalSize);
+		Z.SetNumZeroed(TotalSize);
+		D.SetNumZeroed(TotalSize);
+		Q.SetNumZeroed(TotalSize);
+	}
+
+	const float RhsNorm = MaxAbsInterior(x0, Size);
+	if (RhsNorm <= 0.0f)
+	{
+		return Result;
+	}
+
+	SetMirroredBoundary(x, Size);
+	Result.Residual = ComputeResidual(R.GetData(), x, x0, Size, a, c) / RhsNorm;
+	if (Result.Residual <= Tolerance)
+	{
+		return Result;
+	}
+
+	Precondition(Z.GetData(), R.GetData(), a, c, Size);
+	FMemory::Memcpy(D.GetData(), Z.GetData(), TotalSize * sizeof(float));
+	double RZ = DotInterior(R.GetData(), Z.GetData(), Size);
+
+	float* XData = x;
+	float* RData = R.GetData();
+	float* ZData = Z.GetData();
+	float* DData = D.GetData();
+	float* QData = Q.GetData();
+
+	for (int32 Iteration = 0; Iteration < MaxIterations; Iteration++)
+	{
+		SetMirroredBoundary(DData, Size);
+		ApplyOperator(QData, DData, Size, a, c);
+
+		const double DQ = DotInterior(DData, QData, Size);
+		if (DQ <= 0.0)
+		{
+			break;
+		}
+		const float Alpha = (float)(RZ / DQ);
+
+		const float ResidualNorm = (float)ParallelRowsReduce(Size, [XData, RData, DData, QData, Alpha, Size](int32 j)
+		{
+			float RowMax = 0.0f;
+			for (int32 i = 1; i < Size - 1; i++)
+			{
+				const int32 Index = GridIndex(i, j, Size);
+				XData[Index] += Alpha * DData[Index];
+				RData[Index] -= Alpha * QData[Index];
+				RowMax = FMath::Max(RowMax, FMath::Abs(RData[Index]));
+			}
+			return (double)RowMax;
+		}, CombineMax);
+
+		Result.Iterations = Iteration + 1;
+		Result.Residual = ResidualNorm / RhsNorm;
+		if (Result.Residual <= Tolerance)
+		{
+			break;
+		}
+
+		Precondition(Z.GetData(), R.GetData(), a, c, Size);
+		const double RZNew = DotInterior(RData, ZData, Size);
+		const float Beta = (float)(RZNew / RZ);
+		RZ = RZNew;
+
+		ParallelRows(Size, [DData, ZData, Beta, Size](int32 j)
+		{
+			for (int32 i = 1; i < Size - 1; i++)
+			{
+				const int32 Index = GridIndex(i, j, Size);
+				DData[Index] = ZData[Index] + Beta * DData[Index];
+			}
+		});
+	}
+
+	SetMirroredBoundary(XData, Size);
+	return Result;
+}
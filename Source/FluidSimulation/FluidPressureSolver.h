@@ -0,0 +1,73 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+// Rows handed to each worker by the parallel grid kernels
+static constexpr int32 FluidSolverRowsPerTask = 16;
+
+struct FFluidPressureSolveResult
+{
+	int32 Iterations = 0;
+	float Residual = 0.0f; // Max-norm residual relative to the max-norm of the right-hand side
+};
+
+// Solves c * x - a * (sum of the four neighbours) = x0 over the interior of a Size x Size grid
+// with the same mirrored (b = 0) boundaries that AFluidGrid::SetBoundary applies to pressure.
+class FLUIDSIMULATION_API FFluidPressureSolver
+{
+public:
+	virtual ~FFluidPressureSolver() = default;
+
+	virtual FFluidPressureSolveResult Solve(float* x, const float* x0, float a, float c, int32 Size) = 0;
+
+	float Tolerance = 1.0e-3f;
+	int32 MaxIterations = 8;
+};
+
+// Geometric multigrid V-cycles with red-black Gauss-Seidel smoothing. Each coarse level halves the
+// interior of the level above it on the same row-major layout as AFluidGrid::IX.
+class FLUIDSIMULATION_API FFluidMultigridSolver : public FFluidPressureSolver
+{
+public:
+	virtual FFluidPressureSolveResult Solve(float* x, const float* x0, float a, float c, int32 Size) override;
+
+	// Runs a single symmetric V-cycle from a zero initial guess, so it can precondition a Krylov solver
+	void ApplyVCycle(float* x, const float* x0, float a, float c, int32 Size);
+
+	int32 PreSmoothSweeps = 2;
+	int32 PostSmoothSweeps = 2;
+
+private:
+	struct FLevel
+	{
+		int32 Size = 0;
+		float a = 0.0f;
+		float c = 0.0f;
+		float* X = nullptr;
+		const float* B = nullptr;
+		TArray<float> OwnedX, OwnedB, R;
+	};
+
+	void AllocateLevels(int32 Size, float a, float c);
+	void VCycle(int32 LevelIndex);
+
+	TArray<FLevel> Levels;
+};
+
+// Conjugate gradient preconditioned with one multigrid V-cycle, or with the diagonal when that is
+// disabled. The operator is symmetric positive definite for the a and c used by AFluidGrid::Project.
+class FLUIDSIMULATION_API FFluidConjugateGradientSolver : public FFluidPressureSolver
+{
+public:
+	FFluidConjugateGradientSolver() { MaxIterations = 32; }
+
+	virtual FFluidPressureSolveResult Solve(float* x, const float* x0, float a, float c, int32 Size) override;
+
+	bool bMultigridPreconditioner = true;
+
+private:
+	void Precondition(float* z, const float* r, float a, float c, int32 Size);
+
+	FFluidMultigridSolver Preconditioner;
+	TArray<float> R, Z, D, Q;
+};
@@ -0,0 +1,138 @@
+#include "FluidQualityGovernorComponent.h"
+#include "FluidGrid.h"
+#include "FluidSimulation.h"
+
+namespace
+{
+	// Rough cost of one velocity resolution step up: the velocity stages grow 4x, the density stages not at all
+	constexpr float VelocityResolutionCostFactor = 2.5f;
+
+	EFluidVelocityResolution Coarser(EFluidVelocityResolution Resolution)
+	{
+		return Resolution == EFluidVelocityResolution::Full ? EFluidVelocityResolution::Half : EFluidVelocityResolution::Quarter;
+	}
+
+	EFluidVelocityResolution Finer(EFluidVelocityResolution Resolution)
+	{
+		return Resolution == EFluidVelocityResolution::Quarter ? EFluidVelocityResolution::Half : EFluidVelocityResolution::Full;
+	}
+}
+
+UFluidQualityGovernorComponent::UFluidQualityGovernorComponent()
+{
+	PrimaryComponentTick.bCanEverTick = true;
+}
+
+void UFluidQualityGovernorComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	Grid = Cast<AFluidGrid>(GetOwner());
+	if (!Grid)
+	{
+		UE_LOG(LogFluidSimulation, Warning, TEXT("%s: the quality governor only works on an AFluidGrid"), *GetPathName());
+		SetComponentTickEnabled(false);
+		return;
+	}
+
+	// Measure the frame the grid has just simulated
+	AddTickPrerequisiteActor(Grid);
+
+	MaxPressureIterations = Grid->GetPressureIterations();
+	HighestVelocityResolution = Grid->GetVelocityResolution();
+	MaxSimRate = Grid->GetSimRate();
+}
+
+void UFluidQualityGovernorComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	// Exponential average with the same time constant at any frame rate
+	const float Sample = Grid->GetSimulationMilliseconds();
+	const float Blend = SmoothingTime > 0.0f ? 1.0f - FMath::Exp(-DeltaTime / SmoothingTime) : 1.0f;
+	AverageMilliseconds = bHasAverage ? FMath::Lerp(AverageMilliseconds, Sample, Blend) : Sample;
+	bHasAverage = true;
+
+	TimeSinceAdjust += DeltaTime;
+	if (TimeSinceAdjust < AdjustInterval)
+	{
+		return;
+	}
+
+	const bool bChanged = AverageMilliseconds > BudgetMilliseconds ? Lower() : Raise();
+	if (bChanged)
+	{
+		TimeSinceAdjust = 0.0f;
+	}
+}
+
+bool UFluidQualityGovernorComponent::Lower()
+{
+	const int32 Iterations = Grid->GetPressureIterations();
+	if (Iterations > MinPressureIterations)
+	{
+		Grid->SetPressureIterations(FMath::Max(Iterations - PressureIterationsStep, MinPressureIterations));
+		return true;
+	}
+
+	const EFluidVelocityResolution Resolution = Grid->GetVelocityResolution();
+	if (bAdaptVelocityResolution && Resolution < LowestVelocityResolution)
+	{
+		Grid->SetVelocityResolution(Coarser(Resolution));
+		return true;
+	}
+
+	// Fixed steps advance Dt * ReferenceSimRate / SimRate, so fewer steps keep the fluid's speed and only
+	// coarsen its motion
+	const float Rate = Grid->GetSimRate();
+	if (bAdaptSimRate && Grid->IsFixedTimestep() && Rate > MinSimRate)
+	{
+		Grid->SetSimRate(FMath::Max(Rate - SimRateStep, MinSimRate));
+		return true;
+	}
+
+	return false;
+}
+
+bool UFluidQualityGovernorComponent::Raise()
+{
+	// Each raise has to be predicted to leave headroom, or the next interval would only undo it
+	const float Target = BudgetMilliseconds * RaiseThreshold;
+
+	const float Rate = Grid->GetSimRate();
+	if (bAdaptSimRate && Grid->IsFixedTimestep() && Rate < MaxSimRate)
+	{
+		const float NewRate = FMath::Min(Rate + SimRateStep, MaxSimRate);
+		if (AverageMilliseconds * NewRate / Rate > Target)
+		{
+			return false;
+		}
+		Grid->SetSimRate(NewRate);
+		return true;
+	}
+
+	const EFluidVelocityResolution Resolution = Grid->GetVelocityResolution();
+	if (bAdaptVelocityResolution && Resolution > HighestVelocityResolution)
+	{
+		if (AverageMilliseconds * VelocityResolutionCostFactor > Target)
+		{
+			return false;
+		}
+		Grid->SetVelocityResolution(Finer(Resolution));
+		return true;
+	}
+
+	const int32 Iterations = Grid->GetPressureIterations();
+	if (Iterations < MaxPressureIterations)
+	{
+		const int32 NewIterations = FMath::Min(Iterations + PressureIterationsStep, MaxPressureIterations);
+		if (AverageMilliseconds * NewIterations / Iterations > Target)
+		{
+			return false;
+		}
+		Grid->SetPressureIterations(NewIterations);
+		return true;
+	}
+
+	return false;
+}
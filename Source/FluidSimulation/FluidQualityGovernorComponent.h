@@ -0,0 +1,77 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "FluidSimTypes.h"
+#include "FluidQualityGovernorComponent.generated.h"
+
+class AFluidGrid;
+
+// Holds the owning AFluidGrid to a per-frame simulation budget. It follows a smoothed
+// GetSimulationMilliseconds and makes one change at a time, then waits for it to settle. Over budget it
+// cuts pressure iterations first, then velocity resolution, then the fixed-timestep sim rate. Well under
+// budget it restores them in the opposite order, never past the grid's settings at BeginPlay.
+UCLASS(ClassGroup = "Fluid Simulation", meta = (BlueprintSpawnableComponent))
+class FLUIDSIMULATION_API UFluidQualityGovernorComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	UFluidQualityGovernorComponent();
+
+	UFUNCTION(BlueprintPure, Category = "Fluid Simulation|Governor")
+	float GetAverageMilliseconds() const { return AverageMilliseconds; }
+
+protected:
+	virtual void BeginPlay() override;
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+private:
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Governor", meta = (ClampMin = "0.1"))
+	float BudgetMilliseconds = 2.0f; // Simulation cost per frame to hold the owning grid to
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Governor", meta = (ClampMin = "0.1", ClampMax = "1.0"))
+	float RaiseThreshold = 0.6f; // A raise must be predicted to stay under this fraction of the budget
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Governor", meta = (ClampMin = "0.0"))
+	float SmoothingTime = 0.5f; // Seconds; time constant of the cost average
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Governor", meta = (ClampMin = "0.0"))
+	float AdjustInterval = 1.0f; // Seconds between two changes, so each one shows up in the average first
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Governor", meta = (ClampMin = "1"))
+	int32 MinPressureIterations = 4;
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Governor", meta = (ClampMin = "1"))
+	int32 PressureIterationsStep = 4;
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Governor")
+	bool bAdaptVelocityResolution = true;
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Governor", meta = (EditCondition = "bAdaptVelocityResolution"))
+	EFluidVelocityResolution LowestVelocityResolution = EFluidVelocityResolution::Quarter;
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Governor")
+	bool bAdaptSimRate = true; // Only takes effect when the grid uses a fixed timestep, whose steps lengthen as the rate drops
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Governor", meta = (ClampMin = "1.0", EditCondition = "bAdaptSimRate"))
+	float MinSimRate = 30.0f;
+
+	UPROPERTY(EditAnywhere, Category = "Fluid Simulation|Governor", meta = (ClampMin = "1.0", EditCondition = "bAdaptSimRate"))
+	float SimRateStep = 10.0f;
+
+	UPROPERTY()
+	AFluidGrid* Grid = nullptr;
+
+	// The grid's own settings at BeginPlay: the most the governor restores
+	int32 MaxPressureIterations = 20;
+	EFluidVelocityResolution HighestVelocityResolution = EFluidVelocityResolution::Full;
+	float MaxSimRate = 60.0f;
+
+	float AverageMilliseconds = 0.0f;
+	bool bHasAverage = false;
+	float TimeSinceAdjust = 0.0f;
+
+	bool Lower();
+	bool Raise();
+};
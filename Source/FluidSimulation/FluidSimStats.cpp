@@ -0,0 +1,21 @@
+#include "FluidSimStats.h"
+
+DEFINE_STAT(STAT_FluidSim_Step);
+DEFINE_STAT(STAT_FluidSim_HandleInput);
+DEFINE_STAT(STAT_FluidSim_BrushStrokes);
+DEFINE_STAT(STAT_FluidSim_InjectDensity);
+DEFINE_STAT(STAT_FluidSim_InjectTurbulence);
+DEFINE_STAT(STAT_FluidSim_Diffuse);
+DEFINE_STAT(STAT_FluidSim_Advect);
+DEFINE_STAT(STAT_FluidSim_Project);
+DEFINE_STAT(STAT_FluidSim_SolvePressure);
+DEFINE_STAT(STAT_FluidSim_LinearSolve);
+DEFINE_STAT(STAT_FluidSim_FadeDensity);
+DEFINE_STAT(STAT_FluidSim_ColorMap);
+DEFINE_STAT(STAT_FluidSim_Upload);
+DEFINE_STAT(STAT_FluidSim_StagingWait);
+
+DEFINE_STAT(STAT_FluidSim_LinearSolveSweeps);
+DEFINE_STAT(STAT_FluidSim_PressureIterations);
+DEFINE_STAT(STAT_FluidSim_LinearSolveResidual);
+DEFINE_STAT(STAT_FluidSim_PressureResidual);
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+
+// "stat FluidSim" in the console, and matching FluidSim_* scopes in Unreal Insights
+DECLARE_STATS_GROUP(TEXT("FluidSim"), STATGROUP_FluidSim, STATCAT_Advanced);
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Step"), STAT_FluidSim_Step, STATGROUP_FluidSim, FLUIDSIMULATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("HandleInput"), STAT_FluidSim_HandleInput, STATGROUP_FluidSim, FLUIDSIMULATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Brush Strokes"), STAT_FluidSim_BrushStrokes, STATGROUP_FluidSim, FLUIDSIMULATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Inject Density"), STAT_FluidSim_InjectDensity, STATGROUP_FluidSim, FLUIDSIMULATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Inject Turbulence"), STAT_FluidSim_InjectTurbulence, STATGROUP_FluidSim, FLUIDSIMULATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Diffuse"), STAT_FluidSim_Diffuse, STATGROUP_FluidSim, FLUIDSIMULATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Advect"), STAT_FluidSim_Advect, STATGROUP_FluidSim, FLUIDSIMULATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Project"), STAT_FluidSim_Project, STATGROUP_FluidSim, FLUIDSIMULATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Pressure Solve"), STAT_FluidSim_SolvePressure, STATGROUP_FluidSim, FLUIDSIMULATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("LinearSolve"), STAT_FluidSim_LinearSolve, STATGROUP_FluidSim, FLUIDSIMULATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("FadeDensity"), STAT_FluidSim_FadeDensity, STATGROUP_FluidSim, FLUIDSIMULATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Colour Map"), STAT_FluidSim_ColorMap, STATGROUP_FluidSim, FLUIDSIMULATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Upload (RT)"), STAT_FluidSim_Upload, STATGROUP_FluidSim, FLUIDSIMULATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Staging Wait"), STAT_FluidSim_StagingWait, STATGROUP_FluidSim, FLUIDSIMULATION_API);
+
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("LinearSolve Sweeps"), STAT_FluidSim_LinearSolveSweeps, STATGROUP_FluidSim, FLUIDSIMULATION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Pressure Iterations"), STAT_FluidSim_PressureIterations, STATGROUP_FluidSim, FLUIDSIMULATION_API);
+DECLARE_FLOAT_COUNTER_STAT_EXTERN(TEXT("LinearSolve Residual"), STAT_FluidSim_LinearSolveResidual, STATGROUP_FluidSim, FLUIDSIMULATION_API);
+DECLARE_FLOAT_COUNTER_STAT_EXTERN(TEXT("Pressure Residual"), STAT_FluidSim_PressureResidual, STATGROUP_FluidSim, FLUIDSIMULATION_API);
+
+// One stage: a cycle counter for "stat FluidSim" and a CPU trace scope for Insights
+#define FLUIDSIM_SCOPE(Stage) \
+	SCOPE_CYCLE_COUNTER(STAT_FluidSim_##Stage); \
+	TRACE_CPUPROFILER_EVENT_SCOPE(FluidSim_##Stage)
+
+// Adds the scope's wall time to Accumulator, or does nothing when it is null. The solvers' bRecordStageTimes
+// uses it to fill FFluidSolverStageTimes for the benchmark.
+class FFluidScopedStageTimer
+{
+public:
+	explicit FFluidScopedStageTimer(double* InAccumulator)
+		: Accumulator(InAccumulator)
+		, StartTime(InAccumulator ? FPlatformTime::Seconds() : 0.0)
+	{
+	}
+
+	~FFluidScopedStageTimer()
+	{
+		if (Accumulator)
+		{
+			*Accumulator += FPlatformTime::Seconds() - StartTime;
+		}
+	}
+
+private:
+	double* Accumulator;
+	double StartTime;
+};
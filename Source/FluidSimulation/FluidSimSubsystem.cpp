@@ -0,0 +1,84 @@
+#include "FluidSimSubsystem.h"
+#include "FluidGrid.h"
+#include "Async/ParallelFor.h"
+#include "Camera/PlayerCameraManager.h"
+#include "GameFramework/PlayerController.h"
+
+void UFluidSimSubsystem::RegisterGrid(AFluidGrid* Grid)
+{
+	Grids.AddUnique(Grid);
+}
+
+void UFluidSimSubsystem::UnregisterGrid(AFluidGrid* Grid)
+{
+	Grids.Remove(Grid);
+}
+
+TStatId UFluidSimSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UFluidSimSubsystem, STATGROUP_Tickables);
+}
+
+void UFluidSimSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	FVector ViewLocation;
+	const FVector* ViewLocationPtr = nullptr;
+	if (APlayerController* PlayerController = GetWorld()->GetFirstPlayerController())
+	{
+		if (PlayerController->PlayerCameraManager)
+		{
+			ViewLocation = PlayerController->PlayerCameraManager->GetCameraLocation();
+			ViewLocationPtr = &ViewLocation;
+		}
+	}
+
+	// Game thread: resolution changes, input and the frame's step count, per grid
+	TArray<AFluidGrid*> AwakeGrids;
+	TArray<int32> NumSteps;
+	for (AFluidGrid* Grid : Grids)
+	{
+		if (!IsValid(Grid) || !Grid->IsBatched())
+		{
+			continue;
+		}
+
+		const int32 GridSteps = Grid->BeginBatchedFrame(DeltaTime, ViewLocationPtr);
+		if (GridSteps != INDEX_NONE)
+		{
+			AwakeGrids.Add(Grid);
+			NumSteps.Add(GridSteps);
+		}
+	}
+	NumAwakeGrids = AwakeGrids.Num();
+
+	if (AwakeGrids.IsEmpty())
+	{
+		return;
+	}
+
+	// Workers: each grid's steps and colour map touch only that grid, so grids run side by side. The
+	// solver's own ParallelFors nest inside and pick up whatever workers are left over.
+	TArray<FFluidDensityUpload> Uploads;
+	Uploads.SetNum(AwakeGrids.Num());
+	TArray<bool> HasUpload;
+	HasUpload.SetNumZeroed(AwakeGrids.Num());
+	ParallelFor(AwakeGrids.Num(), [&](int32 i)
+		{
+			HasUpload[i] = AwakeGrids[i]->RunBatchedFrame(NumSteps[i], Uploads[i]);
+		});
+
+	for (int32 i = Uploads.Num() - 1; i >= 0; i--)
+	{
+		if (!HasUpload[i])
+		{
+			Uploads.RemoveAtSwap(i);
+		}
+	}
+
+	if (!Uploads.IsEmpty())
+	{
+		AFluidGrid::SubmitDensityUploads(MoveTemp(Uploads));
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "FluidSimSubsystem.generated.h"
+
+class AFluidGrid;
+
+// Steps every batched AFluidGrid in the world together. Game-thread setup and input run per grid, the
+// solver steps and colour maps of all awake grids run in one ParallelFor, and their texture uploads go
+// to the render thread in a single command. Grids beyond their SleepDistance from the player's camera
+// sleep; grids that were not rendered recently step at a reduced rate.
+UCLASS()
+class FLUIDSIMULATION_API UFluidSimSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	void RegisterGrid(AFluidGrid* Grid);
+	void UnregisterGrid(AFluidGrid* Grid);
+
+	UFUNCTION(BlueprintPure, Category = "Fluid Simulation|Batching")
+	int32 GetNumAwakeGrids() const { return NumAwakeGrids; }
+
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+private:
+	UPROPERTY()
+	TArray<AFluidGrid*> Grids;
+
+	int32 NumAwakeGrids = 0;
+};
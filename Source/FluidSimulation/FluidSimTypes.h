@@ -0,0 +1,50 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "FluidSimTypes.generated.h"
+
+UENUM()
+enum class EFluidSolverOrdering : uint8
+{
+	Serial UMETA(DisplayName = "Serial Gauss-Seidel"),
+	RedBlack UMETA(DisplayName = "Parallel Red-Black Gauss-Seidel"),
+	TemporalBlocked UMETA(DisplayName = "Temporal-Blocked Red-Black Gauss-Seidel")
+};
+
+UENUM()
+enum class EFluidPressureSolver : uint8
+{
+	GaussSeidel UMETA(DisplayName = "Gauss-Seidel (LinearSolve)"),
+	Multigrid UMETA(DisplayName = "Multigrid V-Cycle"),
+	ConjugateGradient UMETA(DisplayName = "Preconditioned Conjugate Gradient")
+};
+
+UENUM(BlueprintType)
+enum class EFluidVelocityResolution : uint8
+{
+	Full UMETA(DisplayName = "Full (Size)"),
+	Half UMETA(DisplayName = "Half (Size / 2)"),
+	Quarter UMETA(DisplayName = "Quarter (Size / 4)")
+};
+
+UENUM(BlueprintType)
+enum class EFluidPresentationMode : uint8
+{
+	Color UMETA(DisplayName = "Colour-Mapped RGBA8 (CPU)"),
+	DensityR16F UMETA(DisplayName = "Raw Density R16F (Palette in Material)"),
+	DensityR8 UMETA(DisplayName = "Quantized Density R8 (Palette in Material)")
+};
+
+UENUM(BlueprintType)
+enum class EFluidFadeMode : uint8
+{
+	Linear UMETA(DisplayName = "Linear (FadeRate density per step)"),
+	Exponential UMETA(DisplayName = "Exponential (FadeRate fraction per step)")
+};
+
+UENUM(BlueprintType)
+enum class EFluidSimulationDimension : uint8
+{
+	Plane UMETA(DisplayName = "2D Plane"),
+	Volume UMETA(DisplayName = "3D Volume (CPU)")
+};
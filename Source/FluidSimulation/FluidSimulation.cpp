@@ -3,4 +3,6 @@
 #include "FluidSimulation.h"
 #include "Modules/ModuleManager.h"
 
+DEFINE_LOG_CATEGORY(LogFluidSimulation);
+
 IMPLEMENT_PRIMARY_GAME_MODULE( FDefaultGameModuleImpl, FluidSimulation, "FluidSimulation" );
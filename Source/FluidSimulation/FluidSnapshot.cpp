@@ -0,0 +1,172 @@
+#include "FluidSnapshot.h"
+#include "Async/MappedFileHandle.h"
+#include "HAL/PlatformFileManager.h"
+#include "Math/Float16.h"
+#include "Misc/Compression.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+namespace
+{
+	enum EFluidSnapshotFlags : uint16
+	{
+		SnapshotFlag_None = 0,
+		SnapshotFlag_Oodle = 1 << 0
+	};
+
+	constexpr int32 MaxSnapshotSize = 4096;
+	constexpr float MaxHalf = 65504.0f;
+
+	int32 GetPayloadBytes(int32 Size, int32 VelocitySize)
+	{
+		return (Size * Size + 2 * VelocitySize * VelocitySize) * sizeof(FFloat16);
+	}
+
+	bool AreSizesValid(int32 Size, int32 VelocitySize)
+	{
+		return Size >= 8 && Size <= MaxSnapshotSize && VelocitySize >= 8 && VelocitySize <= Size;
+	}
+
+	void WriteHalfField(const TArray<float>& Field, FFloat16*& Out)
+	{
+		for (const float Value : Field)
+		{
+			*Out++ = FFloat16(FMath::Clamp(Value, -MaxHalf, MaxHalf));
+		}
+	}
+
+	// A mapped file or caller's view gives no alignment guarantee, so each half is copied out bytewise
+	void ReadHalfField(const uint8*& In, int32 NumCells, TArray<float>& Field)
+	{
+		Field.SetNumUninitialized(NumCells);
+		for (float& Value : Field)
+		{
+			FFloat16 Half;
+			FMemory::Memcpy(&Half.Encoded, In, sizeof(Half.Encoded));
+			In += sizeof(Half.Encoded);
+			Value = Half.GetFloat();
+		}
+	}
+}
+
+bool FFluidSnapshot::IsValid() const
+{
+	return AreSizesValid(Size, VelocitySize) && Density.Num() == Size * Size
+		&& Vx.Num() == VelocitySize * VelocitySize && Vy.Num() == VelocitySize * VelocitySize;
+}
+
+void FFluidSnapshot::Encode(TArray<uint8>& OutBytes, bool bCompress) const
+{
+	check(IsValid());
+
+	int32 PayloadBytes = GetPayloadBytes(Size, VelocitySize);
+	TArray<uint8> Payload;
+	Payload.SetNumUninitialized(PayloadBytes);
+	FFloat16* Out = reinterpret_cast<FFloat16*>(Payload.GetData());
+	WriteHalfField(Density, Out);
+	WriteHalfField(Vx, Out);
+	WriteHalfField(Vy, Out);
+
+	uint16 Flags = SnapshotFlag_None;
+	if (bCompress)
+	{
+		int32 CompressedBytes = FCompression::CompressMemoryBound(NAME_Oodle, PayloadBytes);
+		TArray<uint8> Compressed;
+		Compressed.SetNumUninitialized(CompressedBytes);
+		if (FCompression::CompressMemory(NAME_Oodle, Compressed.GetData(), CompressedBytes, Payload.GetData(), PayloadBytes)
+			&& CompressedBytes < PayloadBytes)
+		{
+			Compressed.SetNum(CompressedBytes);
+			Payload = MoveTemp(Compressed);
+			Flags |= SnapshotFlag_Oodle;
+		}
+	}
+
+	OutBytes.Reset();
+	FMemoryWriter Writer(OutBytes);
+	uint32 HeaderMagic = Magic;
+	uint16 HeaderVersion = Version;
+	int32 HeaderSize = Size;
+	int32 HeaderVelocitySize = VelocitySize;
+	int32 StoredBytes = Payload.Num();
+	Writer << HeaderMagic << HeaderVersion << Flags << HeaderSize << HeaderVelocitySize << PayloadBytes << StoredBytes;
+	Writer.Serialize(Payload.GetData(), StoredBytes);
+}
+
+bool FFluidSnapshot::Decode(TConstArrayView<uint8> Bytes)
+{
+	*this = FFluidSnapshot();
+
+	FMemoryReaderView Reader(Bytes);
+	uint32 HeaderMagic = 0;
+	uint16 HeaderVersion = 0;
+	uint16 Flags = 0;
+	int32 HeaderSize = 0;
+	int32 HeaderVelocitySize = 0;
+	int32 PayloadBytes = 0;
+	int32 StoredBytes = 0;
+	Reader << HeaderMagic << HeaderVersion << Flags << HeaderSize << HeaderVelocitySize << PayloadBytes << StoredBytes;
+
+	if (Reader.IsError() || HeaderMagic != Magic || HeaderVersion > Version || (Flags & ~SnapshotFlag_Oodle) != 0
+		|| !AreSizesValid(HeaderSize, HeaderVelocitySize) || PayloadBytes != GetPayloadBytes(HeaderSize, HeaderVelocitySize)
+		|| StoredBytes <= 0 || StoredBytes > Bytes.Num() - Reader.Tell())
+	{
+		return false;
+	}
+
+	const uint8* Stored = Bytes.GetData() + Reader.Tell();
+	TArray<uint8> Decompressed;
+	if (Flags & SnapshotFlag_Oodle)
+	{
+		Decompressed.SetNumUninitialized(PayloadBytes);
+		if (!FCompression::UncompressMemory(NAME_Oodle, Decompressed.GetData(), PayloadBytes, Stored, StoredBytes))
+		{
+			return false;
+		}
+		Stored = Decompressed.GetData();
+	}
+	else if (StoredBytes != PayloadBytes)
+	{
+		return false;
+	}
+
+	Size = HeaderSize;
+	VelocitySize = HeaderVelocitySize;
+	const uint8* In = Stored;
+	ReadHalfField(In, Size * Size, Density);
+	ReadHalfField(In, VelocitySize * VelocitySize, Vx);
+	ReadHalfField(In, VelocitySize * VelocitySize, Vy);
+	return true;
+}
+
+bool FFluidSnapshot::SaveToFile(const FString& Path, bool bCompress) const
+{
+	TArray<uint8> Bytes;
+	Encode(Bytes, bCompress);
+	return FFileHelper::SaveArrayToFile(Bytes, *Path);
+}
+
+bool FFluidSnapshot::LoadFromFile(const FString& Path)
+{
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	TUniquePtr<IMappedFileHandle> MappedFile(PlatformFile.OpenMapped(*Path));
+	if (MappedFile && MappedFile->GetFileSize() > 0 && MappedFile->GetFileSize() <= MAX_int32)
+	{
+		// The region has to be released before the handle it was mapped from
+		TUniquePtr<IMappedFileRegion> Region(MappedFile->MapRegion(0, MappedFile->GetFileSize()));
+		if (Region)
+		{
+			return Decode(TConstArrayView<uint8>(Region->GetMappedPtr(), (int32)Region->GetMappedSize()));
+		}
+	}
+
+	TArray<uint8> Bytes;
+	return FFileHelper::LoadFileToArray(Bytes, *Path, FILEREAD_Silent) && Decode(Bytes);
+}
+
+FString FFluidSnapshot::ResolvePath(const FString& Path)
+{
+	return FPaths::IsRelative(Path) ? FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("FluidSnapshots"), Path) : Path;
+}
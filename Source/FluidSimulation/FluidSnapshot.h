@@ -0,0 +1,39 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+// The state of one FFluidSolver2D: Density, Vx and Vy, the only fields that carry over between steps.
+// On disk it is a fixed header followed by the three fields as half floats, optionally Oodle-compressed:
+//
+//   uint32 Magic, uint16 Version, uint16 Flags, int32 Size, int32 VelocitySize, int32 PayloadBytes, int32 StoredBytes
+//
+// PayloadBytes is the size of the half-float fields and StoredBytes what follows the header. A snapshot
+// restores onto a grid of any resolution; the solver resamples it.
+struct FLUIDSIMULATION_API FFluidSnapshot
+{
+	static constexpr uint32 Magic = 0x534E4C46; // "FLNS"
+	static constexpr uint16 Version = 1;
+
+	int32 Size = 0;
+	int32 VelocitySize = 0;
+	TArray<float> Density; // Size x Size, boundary ring included
+	TArray<float> Vx;      // VelocitySize x VelocitySize
+	TArray<float> Vy;
+
+	bool IsValid() const;
+
+	// Values beyond the half-float range are clamped to it. Compression is skipped when it does not pay.
+	void Encode(TArray<uint8>& OutBytes, bool bCompress) const;
+
+	// Fails, leaving the snapshot empty, on a bad magic, a newer version, sizes that do not add up or a
+	// payload that does not decompress
+	bool Decode(TConstArrayView<uint8> Bytes);
+
+	// LoadFromFile decodes straight from a memory-mapped view of the file, falling back to reading it
+	// where the platform can not map files. Either may run on any thread.
+	bool SaveToFile(const FString& Path, bool bCompress) const;
+	bool LoadFromFile(const FString& Path);
+
+	// Relative paths are under Saved/FluidSnapshots
+	static FString ResolvePath(const FString& Path);
+};
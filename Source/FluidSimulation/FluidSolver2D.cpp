@@ -0,0 +1,1009 @@
+#include "FluidSolver2D.h"
+#include "Async/ParallelFor.h"
+#include "FluidVectorKernels.h"
+#include "FluidSimStats.h"
+
+namespace
+{
+	// Bilinear resample between two grids over the same unit square, boundary ring included. The caller
+	// reapplies the boundary conditions afterwards.
+	void ResampleField(const float* Source, int32 SourceSize, float* Dest, int32 DestSize)
+	{
+		const float Ratio = (float)(SourceSize - 2) / (DestSize - 2);
+		const float MaxCoordinate = SourceSize - 1.001f;
+		ParallelFor(DestSize, [Source, SourceSize, Dest, DestSize, Ratio, MaxCoordinate](int32 j)
+		{
+			const float y = FMath::Clamp((j - 0.5f) * Ratio + 0.5f, 0.0f, MaxCoordinate);
+			const int32 j0 = FMath::FloorToInt(y);
+			const float t1 = y - j0;
+			const float t0 = 1.0f - t1;
+			for (int32 i = 0; i < DestSize; i++)
+			{
+				const float x = FMath::Clamp((i - 0.5f) * Ratio + 0.5f, 0.0f, MaxCoordinate);
+				const int32 i0 = FMath::FloorToInt(x);
+				const float s1 = x - i0;
+				const float s0 = 1.0f - s1;
+
+				const float* Corner = Source + i0 + j0 * SourceSize;
+				Dest[i + j * DestSize] = s0 * (t0 * Corner[0] + t1 * Corner[SourceSize]) + s1 * (t0 * Corner[1] + t1 * Corner[SourceSize + 1]);
+			}
+		});
+	}
+}
+
+void FFluidSolver2D::AllocateFields()
+{
+	enum EDensityField { DensityField, Density0Field, NumDensityFields };
+	enum EVelocityField { VxField, Vx0Field, VyField, Vy0Field, NumVelocityFields };
+
+	// A resize keeps the current state, resampled onto the new grids. Only Density, Vx and Vy carry
+	// state between steps; the 0 buffers are rewritten by the next step.
+	const int32 NewVelocitySize = GetVelocityGridSize(Settings.Size, Settings.VelocityResolution);
+	TArray<float> OldDensity;
+	if (Size > 0 && Size != Settings.Size)
+	{
+		OldDensity = TArray<float>(Density, Size * Size);
+	}
+	TArray<float> OldVx, OldVy;
+	if (VelocitySize > 0 && VelocitySize != NewVelocitySize)
+	{
+		OldVx = TArray<float>(Vx, VelocitySize * VelocitySize);
+		OldVy = TArray<float>(Vy, VelocitySize * VelocitySize);
+	}
+	const int32 OldSize = Size;
+	const int32 OldVelocitySize = VelocitySize;
+
+	if (FieldArena.Allocate(Settings.Size, NumDensityFields))
+	{
+		Size = Settings.Size;
+		Density = FieldArena.GetField(DensityField);
+		Density0 = FieldArena.GetField(Density0Field);
+
+		DensityTiles.Init(Size, false);
+		AdvectTiles.Init(Size, false);
+
+		if (OldDensity.Num() > 0)
+		{
+			ResampleField(OldDensity.GetData(), OldSize, Density, Size);
+			SetBoundary(Size, 0, Density);
+			DensityTiles.SetAll(true);
+		}
+	}
+
+	if (VelocityArena.Allocate(NewVelocitySize, NumVelocityFields))
+	{
+		VelocitySize = NewVelocitySize;
+		Vx = VelocityArena.GetField(VxField);
+		Vx0 = VelocityArena.GetField(Vx0Field);
+		Vy = VelocityArena.GetField(VyField);
+		Vy0 = VelocityArena.GetField(Vy0Field);
+
+		if (OldVx.Num() > 0)
+		{
+			ResampleField(OldVx.GetData(), OldVelocitySize, Vx, VelocitySize);
+			ResampleField(OldVy.GetData(), OldVelocitySize, Vy, VelocitySize);
+			SetBoundary(VelocitySize, 1, Vx);
+			SetBoundary(VelocitySize, 2, Vy);
+		}
+	}
+}
+
+void FFluidSolver2D::CaptureSnapshot(FFluidSnapshot& OutSnapshot) const
+{
+	OutSnapshot.Size = Size;
+	OutSnapshot.VelocitySize = VelocitySize;
+	OutSnapshot.Density = TArray<float>(Density, Size * Size);
+	OutSnapshot.Vx = TArray<float>(Vx, VelocitySize * VelocitySize);
+	OutSnapshot.Vy = TArray<float>(Vy, VelocitySize * VelocitySize);
+}
+
+void FFluidSolver2D::RestoreSnapshot(const FFluidSnapshot& Snapshot)
+{
+	check(Snapshot.IsValid() && Density && Vx);
+
+	auto RestoreField = [](const TArray<float>& Source, int32 SourceSize, float* Dest, int32 DestSize)
+	{
+		if (SourceSize == DestSize)
+		{
+			FMemory::Memcpy(Dest, Source.GetData(), Source.Num() * sizeof(float));
+		}
+		else
+		{
+			ResampleField(Source.GetData(), SourceSize, Dest, DestSize);
+		}
+	};
+	RestoreField(Snapshot.Density, Snapshot.Size, Density, Size);
+	RestoreField(Snapshot.Vx, Snapshot.VelocitySize, Vx, VelocitySize);
+	RestoreField(Snapshot.Vy, Snapshot.VelocitySize, Vy, VelocitySize);
+	SetBoundary(Size, 0, Density);
+	SetBoundary(VelocitySize, 1, Vx);
+	SetBoundary(VelocitySize, 2, Vy);
+
+	// Only tiles that hold density are active, as if the state had been stepped here
+	DensityTiles.SetAll(false);
+	for (int32 j = 0; j < Size; j++)
+	{
+		for (int32 i = 0; i < Size; i++)
+		{
+			if (Density[IXUnchecked(i, j)] != 0.0f)
+			{
+				DensityTiles.MarkCell(i, j);
+			}
+		}
+	}
+}
+
+int32 FFluidSolver2D::GetVelocityGridSize(int32 DensitySize, EFluidVelocityResolution Resolution)
+{
+	const int32 Shift = Resolution == EFluidVelocityResolution::Quarter ? 2 : (Resolution == EFluidVelocityResolution::Half ? 1 : 0);
+	return FMath::Max(DensitySize >> Shift, FMath::Min(DensitySize, 16));
+}
+
+void FFluidSolver2D::InjectSources(float time)
+{
+	FFluidScopedStageTimer StageTimer(bRecordStageTimes ? &StageTimes.Inject : nullptr);
+
+	int32 cx = Size / 2;
+	int32 cy = Size / 2;
+
+	{
+		FLUIDSIM_SCOPE(InjectDensity);
+
+		// Add multiple affected areas
+		for (int32 offset = -Size / 4; offset <= Size / 4; offset += Size / 4)
+		{
+			for (int32 i = -Settings.AreaSize; i <= Settings.AreaSize; i++)
+			{
+				for (int32 j = -Settings.AreaSize; j <= Settings.AreaSize; j++)
+				{
+					AddDensity(cx + i + offset, cy + j + offset, Settings.AffectedDensity);
+				}
+			}
+		}
+	}
+
+	if (!Settings.bInjectTurbulence)
+	{
+		return;
+	}
+
+	FLUIDSIM_SCOPE(InjectTurbulence);
+
+	// Turbulence comes from a cached field that is resampled every TurbulenceRefreshInterval steps. On a
+	// coarse velocity grid the noise is stretched so the pattern keeps its size on screen.
+	if (TurbulenceField.GetGridSize() != VelocitySize || ++StepsSinceTurbulenceRefresh >= Settings.TurbulenceRefreshInterval)
+	{
+		const float Scale = Settings.TurbulenceScale * ((float)Size / VelocitySize);
+		TurbulenceField.Update(VelocitySize, Scale, time * Settings.TurbulenceSpeed, Settings.AffectedVelocity * 1.2f, Settings.bUseTurbulenceTile);
+		StepsSinceTurbulenceRefresh = 0;
+	}
+	TurbulenceField.Inject(Vx, Vy);
+}
+
+void FFluidSolver2D::FadeDensity()
+{
+	if (Settings.bFuseFade)
+	{
+		return;
+	}
+
+	FLUIDSIM_SCOPE(FadeDensity);
+	FFluidScopedStageTimer StageTimer(bRecordStageTimes ? &StageTimes.Fade : nullptr);
+
+	const FFluidFadeTerms Fade = FFluidFadeTerms::Make(Settings.FadeMode, Settings.FadeRate);
+	if (!Settings.bSparseTiles)
+	{
+		for (int32 i = 0; i < Size * Size; i++)
+		{
+			Density[i] = Fade.Apply(Density[i]);
+		}
+		return;
+	}
+
+	// Inactive tiles are already zero. Tiles that fade out completely drop out of the mask.
+	ParallelFor(DensityTiles.GetNumTilesY(), [this, &Fade](int32 TileY)
+	{
+		const int32 FirstRow = TileY * FFluidTileMask::TileSize;
+		const int32 LastRow = FMath::Min(FirstRow + FFluidTileMask::TileSize, Size);
+		for (int32 TileX = 0; TileX < DensityTiles.GetNumTilesX(); TileX++)
+		{
+			if (!DensityTiles.IsTileActive(TileX, TileY))
+			{
+				continue;
+			}
+
+			const int32 FirstColumn = TileX * FFluidTileMask::TileSize;
+			const int32 LastColumn = FMath::Min(FirstColumn + FFluidTileMask::TileSize, Size);
+			bool bAnyDensity = false;
+			for (int32 j = FirstRow; j < LastRow; j++)
+			{
+				for (int32 i = IXUnchecked(FirstColumn, j); i < IXUnchecked(LastColumn, j); i++)
+				{
+					Density[i] = Fade.Apply(Density[i]);
+					bAnyDensity |= Density[i] != 0.0f;
+				}
+			}
+			DensityTiles.SetTile(TileX, TileY, bAnyDensity);
+		}
+	});
+}
+
+void FFluidSolver2D::ApplyBrushStrokes(TConstArrayView<FFluidBrushStroke> Strokes)
+{
+	if (Strokes.IsEmpty())
+	{
+		return;
+	}
+
+	FLUIDSIM_SCOPE(BrushStrokes);
+	FFluidScopedStageTimer StageTimer(bRecordStageTimes ? &StageTimes.Inject : nullptr);
+
+	const float BrushDensity = Settings.AffectedDensity * 50.0f;
+	float* DensityFields[] = { Density };
+	SplatBrushStrokes(Size, Strokes, DensityFields, 1, [BrushDensity](const FFluidBrushStroke&, float* Amounts)
+	{
+		Amounts[0] = BrushDensity;
+	}, &DensityTiles);
+
+	// The same footprint on the velocity grid, so a coarse cell is pushed once rather than once per
+	// density cell it covers
+	float* VelocityFields[] = { Vx, Vy };
+	SplatBrushStrokes(VelocitySize, Strokes, VelocityFields, 2, [](const FFluidBrushStroke& Stroke, float* Amounts)
+	{
+		Amounts[0] = Stroke.Velocity.X;
+		Amounts[1] = Stroke.Velocity.Y;
+	}, nullptr);
+}
+
+void FFluidSolver2D::SplatBrushStrokes(int32 GridSize, TConstArrayView<FFluidBrushStroke> Strokes, float* const* Fields, int32 NumFields, TFunctionRef<void(const FFluidBrushStroke&, float*)> GetAmounts, FFluidTileMask* Tiles)
+{
+	// Each stroke in this grid's cells: cell i's centre sits at Uv (i + 0.5) / GridSize
+	struct FSplat
+	{
+		float CenterX;
+		float CenterY;
+		float RadiusSq;
+		float InvRadiusSq;
+		float Amounts[2];
+		int32 FirstRow;
+		int32 LastRow;
+	};
+	TArray<FSplat, TInlineAllocator<16>> Splats;
+	int32 FirstRow = GridSize;
+	int32 LastRow = -1;
+	for (const FFluidBrushStroke& Stroke : Strokes)
+	{
+		FSplat& Splat = Splats.AddDefaulted_GetRef();
+		const float Radius = FMath::Max(Stroke.Radius * GridSize, MinBrushRadiusCells);
+		Splat.CenterX = Stroke.Uv.X * GridSize - 0.5f;
+		Splat.CenterY = Stroke.Uv.Y * GridSize - 0.5f;
+		Splat.RadiusSq = Radius * Radius;
+		Splat.InvRadiusSq = 1.0f / Splat.RadiusSq;
+		GetAmounts(Stroke, Splat.Amounts);
+
+		// Strokes only touch the interior; the ghost cells follow in the next SetBoundary
+		Splat.FirstRow = FMath::Max(FMath::CeilToInt(Splat.CenterY - Radius), 1);
+		Splat.LastRow = FMath::Min(FMath::FloorToInt(Splat.CenterY + Radius), GridSize - 2);
+		const int32 FirstColumn = FMath::Max(FMath::CeilToInt(Splat.CenterX - Radius), 1);
+		const int32 LastColumn = FMath::Min(FMath::FloorToInt(Splat.CenterX + Radius), GridSize - 2);
+		if (Splat.FirstRow > Splat.LastRow || FirstColumn > LastColumn)
+		{
+			Splats.Pop(EAllowShrinking::No);
+			continue;
+		}
+
+		FirstRow = FMath::Min(FirstRow, Splat.FirstRow);
+		LastRow = FMath::Max(LastRow, Splat.LastRow);
+		if (Tiles)
+		{
+			Tiles->MarkRect(FirstColumn, Splat.FirstRow, LastColumn, Splat.LastRow);
+		}
+	}
+
+	if (Splats.IsEmpty())
+	{
+		return;
+	}
+
+	// Rows are independent, and every stroke crossing a row is applied by that row's task in queue order
+	ParallelFor(LastRow - FirstRow + 1, [GridSize, Fields, NumFields, &Splats, FirstRow](int32 RowOffset)
+	{
+		const int32 j = FirstRow + RowOffset;
+		const int32 Row = IXUnchecked(0, j, GridSize);
+		for (const FSplat& Splat : Splats)
+		{
+			if (j < Splat.FirstRow || j > Splat.LastRow)
+			{
+				continue;
+			}
+
+			const float dy = j - Splat.CenterY;
+			const float dy2 = dy * dy;
+			const float HalfWidth = FMath::Sqrt(FMath::Max(Splat.RadiusSq - dy2, 0.0f));
+			const int32 First = FMath::Max(FMath::CeilToInt(Splat.CenterX - HalfWidth), 1);
+			const int32 End = FMath::Min(FMath::FloorToInt(Splat.CenterX + HalfWidth), GridSize - 2) + 1;
+
+			int32 i = FluidVectorKernels::SplatRow(Fields, Splat.Amounts, NumFields, Row, First, End, Splat.CenterX, dy2, Splat.InvRadiusSq);
+			for (; i < End; i++)
+			{
+				const float dx = i - Splat.CenterX;
+				const float w = FMath::Max(1.0f - (dx * dx + dy2) * Splat.InvRadiusSq, 0.0f);
+				const float Weight = w * w;
+				for (int32 Field = 0; Field < NumFields; Field++)
+				{
+					Fields[Field][Row + i] += Splat.Amounts[Field] * Weight;
+				}
+			}
+		}
+	});
+}
+
+void FFluidSolver2D::AddDensity(int32 x, int32 y, float amount)
+{
+	int32 Index = IX(x, y);
+	Density[Index] += amount;
+	DensityTiles.MarkCell(Index % Size, Index / Size);
+}
+
+void FFluidSolver2D::AddVelocity(int32 x, int32 y, float amountX, float amountY)
+{
+	x = FMath::Clamp(ToVelocityCell(x), 0, VelocitySize - 1);
+	y = FMath::Clamp(ToVelocityCell(y), 0, VelocitySize - 1);
+	AddVelocityCell(IXUnchecked(x, y, VelocitySize), amountX, amountY);
+}
+
+void FFluidSolver2D::AddVelocityCell(int32 Index, float amountX, float amountY)
+{
+	Vx[Index] += amountX;
+	Vy[Index] += amountY;
+}
+
+void FFluidSolver2D::StepSimulation()
+{
+	FLUIDSIM_SCOPE(Step);
+
+	// The current fields become this step's sources. Diffuse seeds its solve from them, so nothing is copied.
+	Swap(Vx, Vx0);
+	Swap(Vy, Vy0);
+	Swap(Density, Density0);
+
+	float AdjustedViscosity = Settings.Viscosity * 2.0f;
+	float AdjustedDiffusion = Settings.Diffusion * 2.0f;
+	float AdjustedDt = Settings.Dt * 2.0f;
+
+	Diffuse(VelocitySize, 1, Vx, Vx0, AdjustedViscosity, AdjustedDt);
+	Diffuse(VelocitySize, 2, Vy, Vy0, AdjustedViscosity, AdjustedDt);
+
+	Project(Vx, Vy, Vx0, Vy0);
+
+	AdvectVelocity(Vx, Vy, Vx0, Vy0, AdjustedDt);
+
+	Project(Vx, Vy, Vx0, Vy0);
+
+	Diffuse(Size, 0, Density, Density0, AdjustedDiffusion, AdjustedDt);
+
+	// On a coarse velocity grid, density is carried by the velocity resampled to full resolution
+	const float* CarrierX = Vx;
+	const float* CarrierY = Vy;
+	if (VelocitySize != Size)
+	{
+		UpsampleVelocity();
+		CarrierX = UpsampledVx.GetData();
+		CarrierY = UpsampledVy.GetData();
+	}
+
+	AdvectDensity(CarrierX, CarrierY, AdjustedDt);
+
+	// Every field's boundary ring is already final: Advect and Project write it as they finish each row
+}
+
+void FFluidSolver2D::UpsampleVelocity()
+{
+	// Bilinear samples of the coarse grid at the centre of every interior density cell. Both grids span
+	// the same unit square, and the coarse boundary ring supplies the samples next to the walls.
+	UpsampledVx.SetNumUninitialized(Size * Size, EAllowShrinking::No);
+	UpsampledVy.SetNumUninitialized(Size * Size, EAllowShrinking::No);
+
+	const float Ratio = (float)(VelocitySize - 2) / (Size - 2);
+	const float MaxCoordinate = VelocitySize - 1.5f;
+	const int32 NumTasks = FMath::DivideAndRoundUp(Size - 2, FluidSolverRowsPerTask);
+	ParallelFor(NumTasks, [this, Ratio, MaxCoordinate](int32 TaskIndex)
+	{
+		const int32 FirstRow = 1 + TaskIndex * FluidSolverRowsPerTask;
+		const int32 LastRow = FMath::Min(FirstRow + FluidSolverRowsPerTask, Size - 1);
+		for (int32 j = FirstRow; j < LastRow; j++)
+		{
+			const float y = FMath::Clamp((j - 0.5f) * Ratio + 0.5f, 0.5f, MaxCoordinate);
+			const int32 j0 = FMath::FloorToInt(y);
+			const float t1 = y - j0;
+			const float t0 = 1.0f - t1;
+			for (int32 i = 1; i < Size - 1; i++)
+			{
+				const float x = FMath::Clamp((i - 0.5f) * Ratio + 0.5f, 0.5f, MaxCoordinate);
+				const int32 i0 = FMath::FloorToInt(x);
+				const float s1 = x - i0;
+				const float s0 = 1.0f - s1;
+
+				const int32 Corner = IXUnchecked(i0, j0, VelocitySize);
+				const int32 Index = IXUnchecked(i, j);
+				UpsampledVx[Index] = s0 * (t0 * Vx[Corner] + t1 * Vx[Corner + VelocitySize]) + s1 * (t0 * Vx[Corner + 1] + t1 * Vx[Corner + VelocitySize + 1]);
+				UpsampledVy[Index] = s0 * (t0 * Vy[Corner] + t1 * Vy[Corner + VelocitySize]) + s1 * (t0 * Vy[Corner + 1] + t1 * Vy[Corner + VelocitySize + 1]);
+			}
+		}
+	});
+}
+
+void FFluidSolver2D::Diffuse(int32 GridSize, int32 b, float* x, const float* x0, float diff, float dt)
+{
+	FLUIDSIM_SCOPE(Diffuse);
+	FFluidScopedStageTimer StageTimer(bRecordStageTimes ? &StageTimes.Diffuse : nullptr);
+
+	float a = dt * diff * (GridSize - 2) * (GridSize - 2);
+	LinearSolve(GridSize, b, x, x0, a, 1 + 4 * a, Settings.DiffuseIterations, true);
+}
+
+void FFluidSolver2D::Advect(int32 GridSize, int32 b, float* d, const float* d0, const float* velocX, const float* velocY, float dt, const FFluidTileMask* ActiveTiles, const FFluidFadeTerms* Fade)
+{
+	AdvectFields(GridSize, 1, &d, &d0, &b, velocX, velocY, dt, ActiveTiles, Fade);
+}
+
+void FFluidSolver2D::AdvectVelocity(float* velocX, float* velocY, const float* velocX0, const float* velocY0, float dt)
+{
+	// Both components are carried by the same (velocX0, velocY0) field, so one backtrace serves both
+	float* Fields[] = { velocX, velocY };
+	const float* Sources[] = { velocX0, velocY0 };
+	const int32 BoundaryTypes[] = { 1, 2 };
+	AdvectFields(VelocitySize, 2, Fields, Sources, BoundaryTypes, velocX0, velocY0, dt);
+}
+
+void FFluidSolver2D::AdvectDensity(const float* velocX, const float* velocY, float dt)
+{
+	// With a fused fade each row is faded while it is still in cache, so FadeDensity has no pass of its own
+	const FFluidFadeTerms FadeTerms = FFluidFadeTerms::Make(Settings.FadeMode, Settings.FadeRate);
+	const FFluidFadeTerms* Fade = Settings.bFuseFade ? &FadeTerms : nullptr;
+
+	if (!Settings.bSparseTiles)
+	{
+		Advect(Size, 0, Density, Density0, velocX, velocY, dt, nullptr, Fade);
+		DensityTiles.SetAll(true);
+		return;
+	}
+
+	// Density can only reach tiles within one step's travel of where it already is
+	AdvectTiles = DensityTiles;
+	AdvectTiles.Dilate(ComputeAdvectHalo(velocX, velocY, dt));
+	if (Fade)
+	{
+		RowTileDensity.SetNumUninitialized(Size * AdvectTiles.GetNumTilesX(), EAllowShrinking::No);
+	}
+	Advect(Size, 0, Density, Density0, velocX, velocY, dt, &AdvectTiles, Fade);
+	DensityTiles = AdvectTiles;
+
+	if (!Fade)
+	{
+		return;
+	}
+
+	// Tiles that faded out completely drop out of the mask, as they would in FadeDensity
+	const int32 NumTilesX = DensityTiles.GetNumTilesX();
+	for (int32 TileY = 0; TileY < DensityTiles.GetNumTilesY(); TileY++)
+	{
+		const int32 FirstRow = TileY * FFluidTileMask::TileSize;
+		const int32 LastRow = FMath::Min(FirstRow + FFluidTileMask::TileSize, Size);
+		for (int32 TileX = 0; TileX < NumTilesX; TileX++)
+		{
+			if (!DensityTiles.IsTileActive(TileX, TileY))
+			{
+				continue;
+			}
+
+			bool bAnyDensity = false;
+			for (int32 j = FirstRow; j < LastRow && !bAnyDensity; j++)
+			{
+				bAnyDensity = RowTileDensity[j * NumTilesX + TileX] != 0;
+			}
+			DensityTiles.SetTile(TileX, TileY, bAnyDensity);
+		}
+	}
+}
+
+void FFluidSolver2D::AdvectFields(int32 GridSize, int32 NumFields, float* const* d, const float* const* d0, const int32* b, const float* velocX, const float* velocY, float dt, const FFluidTileMask* ActiveTiles, const FFluidFadeTerms* Fade)
+{
+	FLUIDSIM_SCOPE(Advect);
+	FFluidScopedStageTimer StageTimer(bRecordStageTimes ? &StageTimes.Advect : nullptr);
+
+	float dtx = dt * (GridSize - 2);
+	float dty = dt * (GridSize - 2);
+	float Nfloat = GridSize - 2;
+
+	// Advects cells [First, End) of row j
+	auto AdvectSpan = [this, GridSize, NumFields, d, d0, velocX, velocY, dtx, dty, Nfloat](int32 j, int32 First, int32 End)
+	{
+		int32 i = First;
+		if (Settings.bVectorizeAdvect)
+		{
+			i = FluidVectorKernels::AdvectRow(d, d0, NumFields, velocX, velocY, j, i, End, GridSize, dtx, dty);
+		}
+		for (; i < End; i++)
+		{
+			const int32 Index = IXUnchecked(i, j, GridSize);
+			float x = i - dtx * velocX[Index];
+			float y = j - dty * velocY[Index];
+
+			x = FMath::Clamp(x, 0.5f, Nfloat + 0.5f);
+			y = FMath::Clamp(y, 0.5f, Nfloat + 0.5f);
+
+			int32 i0 = FMath::FloorToInt(x);
+			int32 i1 = i0 + 1;
+			int32 j0 = FMath::FloorToInt(y);
+			int32 j1 = j0 + 1;
+
+			float s1 = x - i0;
+			float s0 = 1.0f - s1;
+			float t1 = y - j0;
+			float t0 = 1.0f - t1;
+
+			// The clamp above keeps i0..i1 and j0..j1 inside [0, GridSize - 1]
+			for (int32 Field = 0; Field < NumFields; Field++)
+			{
+				const float* Source = d0[Field];
+				d[Field][Index] = s0 * (t0 * Source[IXUnchecked(i0, j0, GridSize)] + t1 * Source[IXUnchecked(i0, j1, GridSize)]) + s1 * (t0 * Source[IXUnchecked(i1, j0, GridSize)] + t1 * Source[IXUnchecked(i1, j1, GridSize)]);
+			}
+		}
+	};
+
+	// Applies the fused fade to cells [First, End) of row j
+	auto FadeSpan = [GridSize, NumFields, d, Fade](int32 j, int32 First, int32 End)
+	{
+		for (int32 Field = 0; Field < NumFields; Field++)
+		{
+			float* Row = d[Field] + IXUnchecked(0, j, GridSize);
+			for (int32 i = First; i < End; i++)
+			{
+				Row[i] = Fade->Apply(Row[i]);
+			}
+		}
+	};
+
+	// With a fused fade and a tile mask, records which tile columns of row j still hold density. The first
+	// and last interior rows also cover the ghost rows they mirror.
+	const int32 NumTilesX = ActiveTiles ? ActiveTiles->GetNumTilesX() : 0;
+	uint8* RowTiles = (Fade && ActiveTiles) ? RowTileDensity.GetData() : nullptr;
+	auto MarkRowTiles = [GridSize, d, NumTilesX, RowTiles](int32 j)
+	{
+		const float* Row = d[0] + IXUnchecked(0, j, GridSize);
+		for (int32 TileX = 0; TileX < NumTilesX; TileX++)
+		{
+			const int32 First = TileX * FFluidTileMask::TileSize;
+			const int32 End = FMath::Min(First + FFluidTileMask::TileSize, GridSize);
+			bool bAnyDensity = false;
+			for (int32 i = First; i < End; i++)
+			{
+				bAnyDensity |= Row[i] != 0.0f;
+			}
+			RowTiles[j * NumTilesX + TileX] = bAnyDensity;
+		}
+	};
+
+	// Every row writes only its own cells of d, and the ghost cells that mirror them, so row blocks run in parallel
+	const int32 NumTasks = FMath::DivideAndRoundUp(GridSize - 2, FluidSolverRowsPerTask);
+	ParallelFor(NumTasks, [GridSize, NumFields, d, b, ActiveTiles, Fade, RowTiles, &AdvectSpan, &FadeSpan, &MarkRowTiles](int32 TaskIndex)
+	{
+		const int32 FirstRow = 1 + TaskIndex * FluidSolverRowsPerTask;
+		const int32 LastRow = FMath::Min(FirstRow + FluidSolverRowsPerTask, GridSize - 1);
+		for (int32 j = FirstRow; j < LastRow; j++)
+		{
+			if (!ActiveTiles)
+			{
+				AdvectSpan(j, 1, GridSize - 1);
+				if (Fade)
+				{
+					FadeSpan(j, 1, GridSize - 1);
+				}
+			}
+			else
+			{
+				// Inactive tiles sample only zero density, so they are cleared instead
+				const int32 TileY = j / FFluidTileMask::TileSize;
+				for (int32 TileX = 0; TileX < ActiveTiles->GetNumTilesX(); TileX++)
+				{
+					const int32 First = FMath::Max(TileX * FFluidTileMask::TileSize, 1);
+					const int32 End = FMath::Min((TileX + 1) * FFluidTileMask::TileSize, GridSize - 1);
+					if (ActiveTiles->IsTileActive(TileX, TileY))
+					{
+						AdvectSpan(j, First, End);
+						if (Fade)
+						{
+							FadeSpan(j, First, End);
+						}
+					}
+					else if (End > First)
+					{
+						for (int32 Field = 0; Field < NumFields; Field++)
+						{
+							FMemory::Memzero(d[Field] + IXUnchecked(First, j, GridSize), (End - First) * sizeof(float));
+						}
+					}
+				}
+			}
+
+			for (int32 Field = 0; Field < NumFields; Field++)
+			{
+				SetBoundaryRow(GridSize, b[Field], d[Field], j);
+			}
+
+			if (RowTiles)
+			{
+				MarkRowTiles(j);
+				if (j == 1)
+				{
+					MarkRowTiles(0);
+				}
+				if (j == GridSize - 2)
+				{
+					MarkRowTiles(GridSize - 1);
+				}
+			}
+		}
+	});
+}
+
+int32 FFluidSolver2D::ComputeAdvectHalo(const float* velocX, const float* velocY, float dt) const
+{
+	// The backtrace moves at most dt * (Size - 2) * |v| cells along each axis, and the clamp only shortens
+	// it. One more cell covers the far corners of the bilinear footprint.
+	const int32 NumTasks = FMath::DivideAndRoundUp(Size - 2, FluidSolverRowsPerTask);
+	TArray<float, TInlineAllocator<128>> SpeedMax;
+	SpeedMax.SetNumZeroed(NumTasks);
+
+	ParallelFor(NumTasks, [this, velocX, velocY, &SpeedMax](int32 TaskIndex)
+	{
+		const int32 FirstRow = 1 + TaskIndex * FluidSolverRowsPerTask;
+		const int32 LastRow = FMath::Min(FirstRow + FluidSolverRowsPerTask, Size - 1);
+		for (int32 j = FirstRow; j < LastRow; j++)
+		{
+			const int32 Row = IXUnchecked(0, j);
+			for (int32 i = Row + 1; i < Row + Size - 1; i++)
+			{
+				SpeedMax[TaskIndex] = FMath::Max(SpeedMax[TaskIndex], FMath::Max(FMath::Abs(velocX[i]), FMath::Abs(velocY[i])));
+			}
+		}
+	});
+
+	float Speed = 0.0f;
+	for (int32 TaskIndex = 0; TaskIndex < NumTasks; TaskIndex++)
+	{
+		Speed = FMath::Max(Speed, SpeedMax[TaskIndex]);
+	}
+
+	const float Distance = FMath::Min(dt * (Size - 2) * Speed, (float)Size) + 1.0f;
+	return FMath::CeilToInt(Distance / FFluidTileMask::TileSize);
+}
+
+void FFluidSolver2D::Project(float* velocX, float* velocY, float* p, float* div)
+{
+	FLUIDSIM_SCOPE(Project);
+	FFluidScopedStageTimer StageTimer(bRecordStageTimes ? &StageTimes.Project : nullptr);
+
+	const int32 GridSize = VelocitySize;
+
+	for (int32 j = 1; j < GridSize - 1; j++)
+	{
+		const int32 Row = IXUnchecked(0, j, GridSize);
+		int32 i = Row + 1;
+		if (Settings.bVectorizeProject)
+		{
+			i = FluidVectorKernels::DivergenceRow(div, p, velocX, velocY, i, Row + GridSize - 1, GridSize);
+		}
+		for (; i < Row + GridSize - 1; i++)
+		{
+			div[i] = (-0.5f * (velocX[i + 1] - velocX[i - 1] + velocY[i + GridSize] - velocY[i - GridSize])) / GridSize;
+			p[i] = 0;
+		}
+		SetBoundaryRow(GridSize, 0, div, j);
+		SetBoundaryRow(GridSize, 0, p, j);
+	}
+
+	SolvePressure(p, div);
+
+	for (int32 j = 1; j < GridSize - 1; j++)
+	{
+		const int32 Row = IXUnchecked(0, j, GridSize);
+		int32 i = Row + 1;
+		if (Settings.bVectorizeProject)
+		{
+			i = FluidVectorKernels::SubtractGradientRow(velocX, velocY, p, i, Row + GridSize - 1, GridSize);
+		}
+		for (; i < Row + GridSize - 1; i++)
+		{
+			velocX[i] -= 0.5f * (p[i + 1] - p[i - 1]) * GridSize;
+			velocY[i] -= 0.5f * (p[i + GridSize] - p[i - GridSize]) * GridSize;
+		}
+		SetBoundaryRow(GridSize, 1, velocX, j);
+		SetBoundaryRow(GridSize, 2, velocY, j);
+	}
+}
+
+void FFluidSolver2D::SolvePressure(float* p, const float* div)
+{
+	FLUIDSIM_SCOPE(SolvePressure);
+
+	if (Settings.PressureSolverType == EFluidPressureSolver::GaussSeidel)
+	{
+		INC_DWORD_STAT_BY(STAT_FluidSim_PressureIterations, LinearSolve(VelocitySize, 0, p, div, 1, 6, Settings.PressureIterations));
+		return;
+	}
+
+	if (!PressureSolver || ActivePressureSolverType != Settings.PressureSolverType)
+	{
+		if (Settings.PressureSolverType == EFluidPressureSolver::Multigrid)
+		{
+			PressureSolver = MakeUnique<FFluidMultigridSolver>();
+		}
+		else
+		{
+			PressureSolver = MakeUnique<FFluidConjugateGradientSolver>();
+		}
+		ActivePressureSolverType = Settings.PressureSolverType;
+	}
+
+	if (Settings.PressureSolverType == EFluidPressureSolver::Multigrid)
+	{
+		PressureSolver->Tolerance = Settings.MultigridTolerance;
+		PressureSolver->MaxIterations = Settings.MultigridMaxCycles;
+	}
+	else
+	{
+		PressureSolver->Tolerance = Settings.ConjugateGradientTolerance;
+		PressureSolver->MaxIterations = Settings.ConjugateGradientMaxIterations;
+		static_cast<FFluidConjugateGradientSolver*>(PressureSolver.Get())->bMultigridPreconditioner = Settings.bMultigridPreconditioner;
+	}
+
+	const FFluidPressureSolveResult Result = PressureSolver->Solve(p, div, 1, 6, VelocitySize);
+	INC_DWORD_STAT_BY(STAT_FluidSim_PressureIterations, Result.Iterations);
+	SET_FLOAT_STAT(STAT_FluidSim_PressureResidual, Result.Residual);
+	SetBoundary(VelocitySize, 0, p);
+}
+
+int32 FFluidSolver2D::LinearSolve(int32 GridSize, int32 b, float* x, const float* x0, float a, float c, int32 Iterations, bool bSeedFromSource)
+{
+	FLUIDSIM_SCOPE(LinearSolve);
+
+	// Seeding starts the solve from x0 without copying it into x: the first sweep reads cells it has not
+	// visited yet from x0 instead, after taking x0's boundary ring
+	if (bSeedFromSource)
+	{
+		for (int32 i = 0; i < GridSize; i++)
+		{
+			x[IXUnchecked(i, 0, GridSize)] = x0[IXUnchecked(i, 0, GridSize)];
+			x[IXUnchecked(i, GridSize - 1, GridSize)] = x0[IXUnchecked(i, GridSize - 1, GridSize)];
+			x[IXUnchecked(0, i, GridSize)] = x0[IXUnchecked(0, i, GridSize)];
+			x[IXUnchecked(GridSize - 1, i, GridSize)] = x0[IXUnchecked(GridSize - 1, i, GridSize)];
+		}
+	}
+
+	float cRecip = 1.0f / c;
+	int32 Sweeps = 0;
+
+	// Temporal blocking needs room for at least two rows per half-step in a band; smaller grids fit in
+	// cache anyway and take the plain red-black sweeps
+	const int32 BlockSweeps = FMath::Max(Settings.TemporalBlockSweeps, 1);
+	const bool bTemporalBlocked = Settings.SolverOrdering == EFluidSolverOrdering::TemporalBlocked && GridSize - 2 >= 4 * BlockSweeps;
+
+	while (Sweeps < Iterations)
+	{
+		const int32 t = Sweeps;
+		const float* Ahead = (bSeedFromSource && t == 0) ? x0 : x;
+		if (bTemporalBlocked)
+		{
+			// A block never runs past the next residual check
+			int32 NumSweeps = FMath::Min(BlockSweeps, Iterations - Sweeps);
+			if (Settings.bLinearSolveEarlyExit)
+			{
+				NumSweeps = FMath::Min(NumSweeps, Settings.ResidualCheckInterval - Sweeps % Settings.ResidualCheckInterval);
+			}
+			RelaxTemporalBlock(GridSize, b, x, x0, a, cRecip, NumSweeps, bSeedFromSource && t == 0);
+			Sweeps += NumSweeps;
+		}
+		else if (Settings.SolverOrdering != EFluidSolverOrdering::Serial)
+		{
+			Sweeps++;
+			RelaxColor(GridSize, 0, b, x, x0, Ahead, a, cRecip);
+			RelaxColor(GridSize, 1, b, x, x0, x, a, cRecip);
+		}
+		else
+		{
+			Sweeps++;
+
+			// Row j's ghost cells are only read by row j itself, so they can follow it straight away
+			for (int32 j = 1; j < GridSize - 1; j++)
+			{
+				const int32 Row = IXUnchecked(0, j, GridSize);
+				for (int32 i = Row + 1; i < Row + GridSize - 1; i++)
+				{
+					x[i] = (x0[i] + a * (Ahead[i + 1] + x[i - 1] + Ahead[i + GridSize] + x[i - GridSize])) * cRecip;
+				}
+				SetBoundaryRow(GridSize, b, x, j);
+			}
+		}
+
+		if (Settings.bLinearSolveEarlyExit && Sweeps % Settings.ResidualCheckInterval == 0 && Sweeps < Iterations)
+		{
+			const float Residual = ComputeResidual(GridSize, x, x0, a, c);
+			SET_FLOAT_STAT(STAT_FluidSim_LinearSolveResidual, Residual);
+			if (Residual <= Settings.LinearSolveTolerance)
+			{
+				break;
+			}
+		}
+	}
+
+	INC_DWORD_STAT_BY(STAT_FluidSim_LinearSolveSweeps, Sweeps);
+	return Sweeps;
+}
+
+float FFluidSolver2D::ComputeResidual(int32 GridSize, const float* x, const float* x0, float a, float c) const
+{
+	// Max-norm residual of the interior, relative to the max-norm of x0
+	const int32 NumTasks = FMath::DivideAndRoundUp(GridSize - 2, FluidSolverRowsPerTask);
+	TArray<float, TInlineAllocator<128>> ResidualMax, RhsMax;
+	ResidualMax.SetNumZeroed(NumTasks);
+	RhsMax.SetNumZeroed(NumTasks);
+
+	ParallelFor(NumTasks, [GridSize, x, x0, a, c, &ResidualMax, &RhsMax](int32 TaskIndex)
+	{
+		const int32 FirstRow = 1 + TaskIndex * FluidSolverRowsPerTask;
+		const int32 LastRow = FMath::Min(FirstRow + FluidSolverRowsPerTask, GridSize - 1);
+		for (int32 j = FirstRow; j < LastRow; j++)
+		{
+			const int32 Row = IXUnchecked(0, j, GridSize);
+			for (int32 i = Row + 1; i < Row + GridSize - 1; i++)
+			{
+				const float r = x0[i] - (c * x[i] - a * (x[i + 1] + x[i - 1] + x[i + GridSize] + x[i - GridSize]));
+				ResidualMax[TaskIndex] = FMath::Max(ResidualMax[TaskIndex], FMath::Abs(r));
+				RhsMax[TaskIndex] = FMath::Max(RhsMax[TaskIndex], FMath::Abs(x0[i]));
+			}
+		}
+	});
+
+	float Residual = 0.0f;
+	float Rhs = 0.0f;
+	for (int32 TaskIndex = 0; TaskIndex < NumTasks; TaskIndex++)
+	{
+		Residual = FMath::Max(Residual, ResidualMax[TaskIndex]);
+		Rhs = FMath::Max(Rhs, RhsMax[TaskIndex]);
+	}
+	return Rhs > 0.0f ? Residual / Rhs : Residual;
+}
+
+void FFluidSolver2D::RelaxColor(int32 GridSize, int32 Color, int32 b, float* x, const float* x0, const float* Neighbours, float a, float cRecip)
+{
+	// Cells of one colour only read cells of the other colour, so every row block can be relaxed
+	// independently. The second colour finishes each row, so it also writes the row's ghost cells, which
+	// only that row reads.
+	const int32 NumTasks = FMath::DivideAndRoundUp(GridSize - 2, FluidSolverRowsPerTask);
+	ParallelFor(NumTasks, [GridSize, Color, b, x, x0, Neighbours, a, cRecip](int32 TaskIndex)
+	{
+		const int32 FirstRow = 1 + TaskIndex * FluidSolverRowsPerTask;
+		const int32 LastRow = FMath::Min(FirstRow + FluidSolverRowsPerTask, GridSize - 1);
+		for (int32 j = FirstRow; j < LastRow; j++)
+		{
+			RelaxRow(GridSize, Color, b, x, x0, Neighbours, a, cRecip, j);
+		}
+	});
+}
+
+void FFluidSolver2D::RelaxTemporalBlock(int32 GridSize, int32 b, float* x, const float* x0, float a, float cRecip, int32 NumSweeps, bool bSeedFromSource)
+{
+	// NumSweeps red-black sweeps in one pass over the grid, for grids whose fields do not fit in cache.
+	// Half-step h relaxes colour h % 2 and reads only the other colour. So row j can take half-step h once
+	// rows j - 1 and j + 1 have finished h - 1, as long as neither of them has started h + 1 yet. Every
+	// cell is then updated from exactly the values it would see in plain sweeps, so the result is the same
+	// bit for bit.
+	//
+	// Phase 1 splits the rows into bands. Each band runs as a trapezoid that loses a row at each inner
+	// edge per half-step, so it never needs a neighbouring band's later values. Inside a band the rows
+	// advance in a wavefront: row r - h takes half-step h, for every h, before row r + 1 starts. Only the
+	// last 2 * NumSweeps rows or so are live at any time, so they stay in cache. Phase 2 fills the
+	// inverted triangles left between neighbouring bands.
+	const int32 NumHalfSteps = 2 * NumSweeps;
+	const int32 NumRows = GridSize - 2;
+	const int32 BandRows = FMath::Max(FluidSolverRowsPerTask, 2 * NumHalfSteps);
+	const int32 NumBands = FMath::Max(NumRows / BandRows, 1);
+
+	auto RelaxHalfStep = [GridSize, b, x, x0, a, cRecip, bSeedFromSource](int32 h, int32 j)
+	{
+		const float* Neighbours = (bSeedFromSource && h == 0) ? x0 : x;
+		RelaxRow(GridSize, h & 1, b, x, x0, Neighbours, a, cRecip, j);
+	};
+
+	ParallelFor(NumBands, [NumHalfSteps, NumRows, NumBands, &RelaxHalfStep](int32 Band)
+	{
+		// The outermost bands keep their grid edge; the ghost rows there follow row 1 and row GridSize - 2
+		const int32 First = 1 + Band * NumRows / NumBands;
+		const int32 End = 1 + (Band + 1) * NumRows / NumBands;
+		const int32 TopShrink = Band > 0 ? 1 : 0;
+		const int32 BottomShrink = Band < NumBands - 1 ? 1 : 0;
+		for (int32 Front = First; Front < End + NumHalfSteps; Front++)
+		{
+			for (int32 h = 0; h < NumHalfSteps; h++)
+			{
+				const int32 j = Front - h;
+				if (j >= First + h * TopShrink && j < End - h * BottomShrink)
+				{
+					RelaxHalfStep(h, j);
+				}
+			}
+		}
+	});
+
+	// Around each band edge, half-step h is still owed on rows [Edge - h, Edge + h). The rows just outside
+	// have got at most to h, so the triangle can take whole half-steps in order.
+	if (NumBands > 1)
+	{
+		ParallelFor(NumBands - 1, [NumHalfSteps, NumRows, NumBands, &RelaxHalfStep](int32 EdgeIndex)
+		{
+			const int32 Edge = 1 + (EdgeIndex + 1) * NumRows / NumBands;
+			for (int32 h = 1; h < NumHalfSteps; h++)
+			{
+				for (int32 j = Edge - h; j < Edge + h; j++)
+				{
+					RelaxHalfStep(h, j);
+				}
+			}
+		});
+	}
+}
+
+void FFluidSolver2D::SetBoundary(int32 GridSize, int32 b, float* x)
+{
+	for (int32 i = 1; i < GridSize - 1; i++)
+	{
+		x[IXUnchecked(i, 0, GridSize)] = b == 2 ? -x[IXUnchecked(i, 1, GridSize)] : x[IXUnchecked(i, 1, GridSize)];
+		x[IXUnchecked(i, GridSize - 1, GridSize)] = b == 2 ? -x[IXUnchecked(i, GridSize - 2, GridSize)] : x[IXUnchecked(i, GridSize - 2, GridSize)];
+	}
+	for (int32 j = 1; j < GridSize - 1; j++)
+	{
+		x[IXUnchecked(0, j, GridSize)] = b == 1 ? -x[IXUnchecked(1, j, GridSize)] : x[IXUnchecked(1, j, GridSize)];
+		x[IXUnchecked(GridSize - 1, j, GridSize)] = b == 1 ? -x[IXUnchecked(GridSize - 2, j, GridSize)] : x[IXUnchecked(GridSize - 2, j, GridSize)];
+	}
+
+	x[IXUnchecked(0, 0, GridSize)] = 0.5f * (x[IXUnchecked(1, 0, GridSize)] + x[IXUnchecked(0, 1, GridSize)]);
+	x[IXUnchecked(0, GridSize - 1, GridSize)] = 0.5f * (x[IXUnchecked(1, GridSize - 1, GridSize)] + x[IXUnchecked(0, GridSize - 2, GridSize)]);
+	x[IXUnchecked(GridSize - 1, 0, GridSize)] = 0.5f * (x[IXUnchecked(GridSize - 2, 0, GridSize)] + x[IXUnchecked(GridSize - 1, 1, GridSize)]);
+	x[IXUnchecked(GridSize - 1, GridSize - 1, GridSize)] = 0.5f * (x[IXUnchecked(GridSize - 2, GridSize - 1, GridSize)] + x[IXUnchecked(GridSize - 1, GridSize - 2, GridSize)]);
+}
+
+int32 FFluidSolver2D::IX(int32 x, int32 y) const
+{
+	x = FMath::Clamp(x, 0, Size - 1);
+	y = FMath::Clamp(y, 0, Size - 1);
+
+	return x + (y * Size);
+}
+
+float FFluidSolver2D::ComputeDivergenceNorm() const
+{
+	// Max-norm of the discrete divergence over the interior, on the same stencil Project removes
+	float Norm = 0.0f;
+	for (int32 j = 1; j < VelocitySize - 1; j++)
+	{
+		for (int32 i = 1; i < VelocitySize - 1; i++)
+		{
+			const int32 Index = IXUnchecked(i, j, VelocitySize);
+			const float Divergence = 0.5f * (Vx[Index + 1] - Vx[Index - 1] + Vy[Index + VelocitySize] - Vy[Index - VelocitySize]);
+			Norm = FMath::Max(Norm, FMath::Abs(Divergence));
+		}
+	}
+	return Norm;
+}
+
+double FFluidSolver2D::ComputeDensityChecksum() const
+{
+	double Sum = 0.0;
+	for (int32 i = 0; i < Size * Size; i++)
+	{
+		Sum += Density[i];
+	}
+	return Sum;
+}
@@ -0,0 +1,266 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "FluidSimTypes.h"
+#include "FluidPressureSolver.h"
+#include "FluidFieldArena.h"
+#include "FluidTurbulenceField.h"
+#include "FluidTileMask.h"
+#include "FluidSnapshot.h"
+
+// Everything the solver reads from AFluidGrid's properties. Copied in before each step.
+struct FFluidSolverSettings
+{
+	int32 Size = 256;
+	int32 AreaSize = 100;
+	float AffectedDensity = 10.0f;
+	float AffectedVelocity = 100.0f;
+	float Dt = 0.1f;
+	float Diffusion = 0.0001f;
+	float Viscosity = 0.0001f;
+	float TurbulenceScale = 15.0f;
+	float TurbulenceSpeed = 5.0f;
+	bool bUseTurbulenceTile = true;
+	int32 TurbulenceRefreshInterval = 1;
+	bool bInjectTurbulence = true; // Only the benchmark's NoTurbulence runs turn it off
+
+	EFluidSolverOrdering SolverOrdering = EFluidSolverOrdering::Serial;
+	int32 TemporalBlockSweeps = 4;
+	int32 DiffuseIterations = 20;
+	int32 PressureIterations = 20;
+	bool bLinearSolveEarlyExit = false;
+	float LinearSolveTolerance = 1.0e-4f;
+	int32 ResidualCheckInterval = 4;
+
+	EFluidPressureSolver PressureSolverType = EFluidPressureSolver::GaussSeidel;
+	float MultigridTolerance = 1.0e-3f;
+	int32 MultigridMaxCycles = 8;
+	float ConjugateGradientTolerance = 1.0e-3f;
+	int32 ConjugateGradientMaxIterations = 32;
+	bool bMultigridPreconditioner = true;
+
+	bool bVectorizeProject = true;
+	bool bVectorizeAdvect = true;
+	bool bSparseTiles = true;
+	EFluidVelocityResolution VelocityResolution = EFluidVelocityResolution::Full;
+
+	EFluidFadeMode FadeMode = EFluidFadeMode::Linear;
+	float FadeRate = 0.5f;
+	bool bFuseFade = true;
+};
+
+// The per-step density fade, d' = Clamp(d * Scale - Amount, 0, 255) snapped to zero below Cutoff. Linear
+// fades subtract, and exponential ones scale down and cut off the tail they would otherwise never reach.
+struct FFluidFadeTerms
+{
+	float Scale = 1.0f;
+	float Amount = 0.5f;
+	float Cutoff = 0.0f;
+
+	static FFluidFadeTerms Make(EFluidFadeMode Mode, float Rate)
+	{
+		FFluidFadeTerms Terms;
+		if (Mode == EFluidFadeMode::Exponential)
+		{
+			Terms.Scale = 1.0f - FMath::Clamp(Rate, 0.0f, 1.0f);
+			Terms.Amount = 0.0f;
+			Terms.Cutoff = 0.5f; // Below half a unit of the 0..255 density range nothing shows
+		}
+		else
+		{
+			Terms.Amount = FMath::Max(Rate, 0.0f);
+		}
+		return Terms;
+	}
+
+	FORCEINLINE float Apply(float d) const
+	{
+		const float Faded = FMath::Clamp(d * Scale - Amount, 0.0f, 255.0f);
+		return Faded < Cutoff ? 0.0f : Faded;
+	}
+};
+
+// One brush splat from AFluidGrid::QueueBrushStroke. Density and velocity are added under a smooth
+// (1 - r^2 / Radius^2)^2 falloff, so a stroke has no hard edge at any grid resolution.
+struct FFluidBrushStroke
+{
+	FVector2D Uv = FVector2D::ZeroVector;      // Centre on the grid, 0..1 along each axis
+	float Radius = 0.0f;                        // In Uv units; never less than MinBrushRadiusCells on either grid
+	FVector2D Velocity = FVector2D::ZeroVector; // Added at the centre and fading out with the falloff
+};
+
+// Wall time spent in each stage since the last Reset, filled in when bRecordStageTimes is set
+struct FFluidSolverStageTimes
+{
+	double Inject = 0.0;
+	double Diffuse = 0.0;
+	double Advect = 0.0;
+	double Project = 0.0;
+	double Fade = 0.0;
+
+	void Reset() { *this = FFluidSolverStageTimes(); }
+};
+
+// The Stam / Mike Ash solver on a Size x Size grid, independent of any actor or world so it can run
+// headless. AFluidGrid owns one and drives it from Tick or from its async task.
+class FLUIDSIMULATION_API FFluidSolver2D
+{
+public:
+	FFluidSolverSettings Settings;
+
+	// Reallocates the fields when Settings.Size or Settings.VelocityResolution has changed. The first
+	// allocation starts from zero; later ones resample the current density and velocity onto the new grids.
+	void AllocateFields();
+
+	// Restore resamples the snapshot onto the grids as allocated, so it loads at any Size or
+	// VelocityResolution. AllocateFields must have run.
+	void CaptureSnapshot(FFluidSnapshot& OutSnapshot) const;
+	void RestoreSnapshot(const FFluidSnapshot& Snapshot);
+
+	// The velocity and pressure grid size for a density grid of DensitySize
+	static int32 GetVelocityGridSize(int32 DensitySize, EFluidVelocityResolution Resolution);
+
+	void InjectSources(float time);
+
+	// Splats every stroke in one row-parallel pass per grid. Each stroke adds up to
+	// Settings.AffectedDensity * 50 density at its centre, and its Velocity on the velocity grid.
+	void ApplyBrushStrokes(TConstArrayView<FFluidBrushStroke> Strokes);
+	static constexpr float MinBrushRadiusCells = 1.5f;
+
+	void AddDensity(int32 x, int32 y, float amount);
+	void AddVelocity(int32 x, int32 y, float amountX, float amountY);
+
+	void StepSimulation();
+
+	// With Settings.bFuseFade the density advect in StepSimulation already applied the fade, and this does nothing
+	void FadeDensity();
+
+	int32 GetSize() const { return Size; }
+	int32 GetVelocitySize() const { return VelocitySize; }
+	const float* GetDensity() const { return Density; }
+
+	// On the VelocitySize grid
+	const float* GetVelocityX() const { return Vx; }
+	const float* GetVelocityY() const { return Vy; }
+
+	// Tiles that may hold non-zero density. Every cell outside them is exactly zero.
+	const FFluidTileMask& GetDensityTiles() const { return DensityTiles; }
+
+	// Max-norm of the interior velocity divergence (on the velocity grid), and the sum of all density. Used to spot numerical drift.
+	float ComputeDivergenceNorm() const;
+	double ComputeDensityChecksum() const;
+
+	bool bRecordStageTimes = false;
+	FFluidSolverStageTimes StageTimes;
+
+	int32 IX(int32 x, int32 y) const;
+
+	// No clamping: only for loops that stay inside the grid. External coordinates go through IX.
+	FORCEINLINE int32 IXUnchecked(int32 x, int32 y) const
+	{
+		return x + y * Size;
+	}
+
+private:
+	// Routines that run on either grid take its size first. Velocity-only ones use VelocitySize.
+	void Diffuse(int32 GridSize, int32 b, float* x, const float* x0, float diff, float dt);
+	void Advect(int32 GridSize, int32 b, float* d, const float* d0, const float* velocX, const float* velocY, float dt, const FFluidTileMask* ActiveTiles = nullptr, const FFluidFadeTerms* Fade = nullptr);
+	void AdvectVelocity(float* velocX, float* velocY, const float* velocX0, const float* velocY0, float dt);
+	void AdvectFields(int32 GridSize, int32 NumFields, float* const* d, const float* const* d0, const int32* b, const float* velocX, const float* velocY, float dt, const FFluidTileMask* ActiveTiles = nullptr, const FFluidFadeTerms* Fade = nullptr);
+	void AdvectDensity(const float* velocX, const float* velocY, float dt);
+	int32 ComputeAdvectHalo(const float* velocX, const float* velocY, float dt) const;
+	void UpsampleVelocity();
+	void AddVelocityCell(int32 Index, float amountX, float amountY);
+	static void SplatBrushStrokes(int32 GridSize, TConstArrayView<FFluidBrushStroke> Strokes, float* const* Fields, int32 NumFields, TFunctionRef<void(const FFluidBrushStroke&, float*)> GetAmounts, FFluidTileMask* Tiles);
+	void Project(float* velocX, float* velocY, float* p, float* div);
+	void SolvePressure(float* p, const float* div);
+	int32 LinearSolve(int32 GridSize, int32 b, float* x, const float* x0, float a, float c, int32 Iterations, bool bSeedFromSource = false);
+	void RelaxColor(int32 GridSize, int32 Color, int32 b, float* x, const float* x0, const float* Neighbours, float a, float cRecip);
+	void RelaxTemporalBlock(int32 GridSize, int32 b, float* x, const float* x0, float a, float cRecip, int32 NumSweeps, bool bSeedFromSource);
+	float ComputeResidual(int32 GridSize, const float* x, const float* x0, float a, float c) const;
+	void SetBoundary(int32 GridSize, int32 b, float* x);
+
+	// The boundary ring doubles as ghost cells. This writes the ones that mirror interior row j: the
+	// row's own two ends, and the whole ghost row with its corners when j is the first or last interior
+	// row. Once every interior row has been through it, the ring matches SetBoundary exactly. Stencils call
+	// it as soon as a row is final, so the edge columns are written while the row is still in cache
+	// instead of in a stride-GridSize walk afterwards, and no extra pass touches the grid.
+	FORCEINLINE static void SetBoundaryRow(int32 GridSize, int32 b, float* x, int32 j)
+	{
+		float* Row = x + j * GridSize;
+		Row[0] = b == 1 ? -Row[1] : Row[1];
+		Row[GridSize - 1] = b == 1 ? -Row[GridSize - 2] : Row[GridSize - 2];
+
+		if (j == 1 || j == GridSize - 2)
+		{
+			float* Ghost = j == 1 ? x : x + (GridSize - 1) * GridSize;
+			for (int32 i = 1; i < GridSize - 1; i++)
+			{
+				Ghost[i] = b == 2 ? -Row[i] : Row[i];
+			}
+			Ghost[0] = 0.5f * (Ghost[1] + Row[0]);
+			Ghost[GridSize - 1] = 0.5f * (Ghost[GridSize - 2] + Row[GridSize - 1]);
+		}
+	}
+
+	FORCEINLINE static int32 IXUnchecked(int32 x, int32 y, int32 GridSize)
+	{
+		return x + y * GridSize;
+	}
+
+	// One colour of one row of a red-black sweep. The second colour completes the row, so it also writes
+	// the row's ghost cells.
+	FORCEINLINE static void RelaxRow(int32 GridSize, int32 Color, int32 b, float* x, const float* x0, const float* Neighbours, float a, float cRecip, int32 j)
+	{
+		const int32 Row = IXUnchecked(0, j, GridSize);
+		for (int32 i = Row + 1 + ((j + Color + 1) & 1); i < Row + GridSize - 1; i += 2)
+		{
+			x[i] = (x0[i] + a * (Neighbours[i + 1] + Neighbours[i - 1] + Neighbours[i + GridSize] + Neighbours[i - GridSize])) * cRecip;
+		}
+		if (Color == 1)
+		{
+			SetBoundaryRow(GridSize, b, x, j);
+		}
+	}
+
+	// Maps a density cell coordinate onto the velocity grid
+	FORCEINLINE int32 ToVelocityCell(int32 x) const
+	{
+		return x * VelocitySize / Size;
+	}
+
+	// The allocated grid sizes; Settings only take effect in AllocateFields. Density is Size x Size, and
+	// velocity and pressure are VelocitySize x VelocitySize over the same unit square.
+	int32 Size = 0;
+	int32 VelocitySize = 0;
+
+	// Views into FieldArena and VelocityArena. StepSimulation swaps each field with its 0 buffer rather than copying it.
+	float* Density = nullptr;
+	float* Density0 = nullptr;
+	float* Vx = nullptr;
+	float* Vx0 = nullptr;
+	float* Vy = nullptr;
+	float* Vy0 = nullptr;
+
+	FFluidFieldArena FieldArena;
+	FFluidFieldArena VelocityArena;
+
+	// The coarse velocity resampled onto the density grid, when the two differ
+	TArray<float> UpsampledVx;
+	TArray<float> UpsampledVy;
+
+	// Density activity, updated by AddDensity and by every density advect and fade. AdvectTiles is the
+	// density footprint grown by how far this step's velocity can carry it.
+	FFluidTileMask DensityTiles;
+	FFluidTileMask AdvectTiles;
+
+	// Fused fade with sparse tiles: whether each row still holds density in each tile column, written by
+	// the row's own advect task and folded into DensityTiles afterwards
+	TArray<uint8> RowTileDensity;
+
+	FFluidTurbulenceField TurbulenceField;
+	int32 StepsSinceTurbulenceRefresh = 0;
+
+	TUniquePtr<FFluidPressureSolver> PressureSolver;
+	EFluidPressureSolver ActivePressureSolverType = EFluidPressureSolver::GaussSeidel;
+};
@@ -0,0 +1,793 @@
+#include "FluidSolver3D.h"
+#include "Async/ParallelFor.h"
+#include "FluidVectorKernels.h"
+#include "FluidSimStats.h"
+
+namespace
+{
+	// The plume's upward speed and the turbulence amplitude, per unit of Settings.AffectedVelocity, and the
+	// share of a brush stroke's velocity that is added. The 2D factors would move density across the whole
+	// volume every step.
+	constexpr float PlumeSpeedScale = 0.002f;
+	constexpr float TurbulenceAmplitudeScale = 0.004f;
+	constexpr float BrushVelocityScale = 0.0002f;
+}
+
+void FFluidSolver3D::AllocateFields()
+{
+	enum EField { DensityField, Density0Field, VxField, Vx0Field, VyField, Vy0Field, VzField, Vz0Field, NumFields };
+
+	if (FieldArena.Allocate(Settings.Size, NumFields, Settings.Size))
+	{
+		Size = Settings.Size;
+		Density = FieldArena.GetField(DensityField);
+		Density0 = FieldArena.GetField(Density0Field);
+		Vx = FieldArena.GetField(VxField);
+		Vx0 = FieldArena.GetField(Vx0Field);
+		Vy = FieldArena.GetField(VyField);
+		Vy0 = FieldArena.GetField(Vy0Field);
+		Vz = FieldArena.GetField(VzField);
+		Vz0 = FieldArena.GetField(Vz0Field);
+
+		DensityBricks.Init(Size, false, true);
+		AdvectBricks.Init(Size, false, true);
+		TurbulenceX.Reset();
+	}
+}
+
+void FFluidSolver3D::InjectSources(float time)
+{
+	FFluidScopedStageTimer StageTimer(bRecordStageTimes ? &StageTimes.Inject : nullptr);
+
+	{
+		FLUIDSIM_SCOPE(InjectDensity);
+
+		// AreaSize is in cells of the default 256 plane, so the source keeps its share of the floor at any
+		// Size, at a quarter of the width the 2D sources cover
+		const int32 HalfWidth = FMath::Clamp(Settings.AreaSize * Size / 1024, 1, Size / 2 - 2);
+		const int32 First = Size / 2 - HalfWidth;
+		const int32 End = Size / 2 + HalfWidth;
+		const int32 Height = FMath::Min(2 * HalfWidth, Size - 2);
+		const float PlumeSpeed = Settings.AffectedVelocity * PlumeSpeedScale;
+		ParallelFor(Height, [this, First, End, PlumeSpeed](int32 Layer)
+		{
+			const int32 z = 1 + Layer;
+			for (int32 y = First; y < End; y++)
+			{
+				for (int32 Index = IXUnchecked(First, y, z); Index < IXUnchecked(End, y, z); Index++)
+				{
+					Density[Index] += Settings.AffectedDensity;
+					Vz[Index] += PlumeSpeed;
+				}
+			}
+		});
+		DensityBricks.MarkBox(First, First, 1, End - 1, End - 1, Height);
+	}
+
+	if (!Settings.bInjectTurbulence)
+	{
+		return;
+	}
+
+	FLUIDSIM_SCOPE(InjectTurbulence);
+
+	if (TurbulenceX.Num() != Size * Size * Size || ++StepsSinceTurbulenceRefresh >= Settings.TurbulenceRefreshInterval)
+	{
+		UpdateTurbulence(time);
+		StepsSinceTurbulenceRefresh = 0;
+	}
+
+	ParallelFor(Size, [this](int32 z)
+	{
+		for (int32 Index = IXUnchecked(0, 0, z); Index < IXUnchecked(0, 0, z + 1); Index++)
+		{
+			Vx[Index] += TurbulenceX[Index];
+			Vy[Index] += TurbulenceY[Index];
+			Vz[Index] += TurbulenceZ[Index];
+		}
+	});
+}
+
+void FFluidSolver3D::UpdateTurbulence(float time)
+{
+	const int32 NumCells = Size * Size * Size;
+	TurbulenceX.SetNumUninitialized(NumCells);
+	TurbulenceY.SetNumUninitialized(NumCells);
+	TurbulenceZ.SetNumUninitialized(NumCells);
+
+	// TurbulenceScale noise periods across the volume rather than per cell as on the plane: white noise
+	// per cell would only be diffused away in the larger volume cells. Each component is the noise
+	// shifted along its own axis, as in FFluidTurbulenceField.
+	const float Scale = Settings.TurbulenceScale / Size;
+	const float Offset = time * Settings.TurbulenceSpeed;
+	const float Amplitude = Settings.AffectedVelocity * TurbulenceAmplitudeScale;
+	ParallelFor(Size, [this, Scale, Offset, Amplitude](int32 z)
+	{
+		for (int32 y = 0; y < Size; y++)
+		{
+			for (int32 x = 0; x < Size; x++)
+			{
+				const FVector Position(x * Scale, y * Scale, z * Scale);
+				const int32 Index = IXUnchecked(x, y, z);
+				TurbulenceX[Index] = FMath::PerlinNoise3D(Position + FVector(Offset, 0.0f, 0.0f)) * Amplitude;
+				TurbulenceY[Index] = FMath::PerlinNoise3D(Position + FVector(0.0f, Offset, 0.0f)) * Amplitude;
+				TurbulenceZ[Index] = FMath::PerlinNoise3D(Position + FVector(0.0f, 0.0f, Offset)) * Amplitude;
+			}
+		}
+	});
+}
+
+void FFluidSolver3D::ApplyBrushStrokes(TConstArrayView<FFluidBrushStroke> Strokes)
+{
+	if (Strokes.IsEmpty())
+	{
+		return;
+	}
+
+	FLUIDSIM_SCOPE(BrushStrokes);
+	FFluidScopedStageTimer StageTimer(bRecordStageTimes ? &StageTimes.Inject : nullptr);
+
+	// Each stroke in cells, clipped to the interior: cell i's centre sits at (i + 0.5) / Size
+	struct FSplat
+	{
+		float CenterX;
+		float CenterY;
+		float CenterZ;
+		float RadiusSq;
+		float InvRadiusSq;
+		float Amounts[3];
+		int32 MinY;
+		int32 MaxY;
+		int32 MinZ;
+		int32 MaxZ;
+	};
+	TArray<FSplat, TInlineAllocator<16>> Splats;
+	int32 FirstSlice = Size;
+	int32 LastSlice = -1;
+	for (const FFluidBrushStroke& Stroke : Strokes)
+	{
+		FSplat& Splat = Splats.AddDefaulted_GetRef();
+		const float Radius = FMath::Max(Stroke.Radius * Size, FFluidSolver2D::MinBrushRadiusCells);
+		Splat.CenterX = Stroke.Uv.X * Size - 0.5f;
+		Splat.CenterY = Stroke.Uv.Y * Size - 0.5f;
+		Splat.CenterZ = BrushHeight * Size - 0.5f;
+		Splat.RadiusSq = Radius * Radius;
+		Splat.InvRadiusSq = 1.0f / Splat.RadiusSq;
+		Splat.Amounts[0] = Settings.AffectedDensity * 50.0f;
+		Splat.Amounts[1] = Stroke.Velocity.X * BrushVelocityScale;
+		Splat.Amounts[2] = Stroke.Velocity.Y * BrushVelocityScale;
+
+		const int32 MinX = FMath::Max(FMath::CeilToInt(Splat.CenterX - Radius), 1);
+		const int32 MaxX = FMath::Min(FMath::FloorToInt(Splat.CenterX + Radius), Size - 2);
+		Splat.MinY = FMath::Max(FMath::CeilToInt(Splat.CenterY - Radius), 1);
+		Splat.MaxY = FMath::Min(FMath::FloorToInt(Splat.CenterY + Radius), Size - 2);
+		Splat.MinZ = FMath::Max(FMath::CeilToInt(Splat.CenterZ - Radius), 1);
+		Splat.MaxZ = FMath::Min(FMath::FloorToInt(Splat.CenterZ + Radius), Size - 2);
+		if (MinX > MaxX || Splat.MinY > Splat.MaxY || Splat.MinZ > Splat.MaxZ)
+		{
+			Splats.Pop(EAllowShrinking::No);
+			continue;
+		}
+
+		FirstSlice = FMath::Min(FirstSlice, Splat.MinZ);
+		LastSlice = FMath::Max(LastSlice, Splat.MaxZ);
+		DensityBricks.MarkBox(MinX, Splat.MinY, Splat.MinZ, MaxX, Splat.MaxY, Splat.MaxZ);
+	}
+
+	if (Splats.IsEmpty())
+	{
+		return;
+	}
+
+	// Slices are independent, and every stroke crossing a row is applied by its slice's task in queue order
+	float* Fields[] = { Density, Vx, Vy };
+	ParallelFor(LastSlice - FirstSlice + 1, [this, &Fields, &Splats, FirstSlice](int32 SliceOffset)
+	{
+		const int32 z = FirstSlice + SliceOffset;
+		for (const FSplat& Splat : Splats)
+		{
+			if (z < Splat.MinZ || z > Splat.MaxZ)
+			{
+				continue;
+			}
+
+			const float dz = z - Splat.CenterZ;
+			for (int32 y = Splat.MinY; y <= Splat.MaxY; y++)
+			{
+				const float dy = y - Splat.CenterY;
+				const float dy2 = dy * dy + dz * dz;
+				const float HalfWidth = FMath::Sqrt(FMath::Max(Splat.RadiusSq - dy2, 0.0f));
+				const int32 First = FMath::Max(FMath::CeilToInt(Splat.CenterX - HalfWidth), 1);
+				const int32 End = FMath::Min(FMath::FloorToInt(Splat.CenterX + HalfWidth), Size - 2) + 1;
+
+				const int32 Row = IXUnchecked(0, y, z);
+				int32 i = FluidVectorKernels::SplatRow(Fields, Splat.Amounts, 3, Row, First, End, Splat.CenterX, dy2, Splat.InvRadiusSq);
+				for (; i < End; i++)
+				{
+					const float dx = i - Splat.CenterX;
+					const float w = FMath::Max(1.0f - (dx * dx + dy2) * Splat.InvRadiusSq, 0.0f);
+					const float Weight = w * w;
+					for (int32 Field = 0; Field < 3; Field++)
+					{
+						Fields[Field][Row + i] += Splat.Amounts[Field] * Weight;
+					}
+				}
+			}
+		}
+	});
+}
+
+void FFluidSolver3D::StepSimulation()
+{
+	FLUIDSIM_SCOPE(Step);
+
+	// The current fields become this step's sources
+	Swap(Vx, Vx0);
+	Swap(Vy, Vy0);
+	Swap(Vz, Vz0);
+	Swap(Density, Density0);
+
+	// The same factors as FFluidSolver2D, so a grid's properties mean the same in both modes
+	const float AdjustedViscosity = Settings.Viscosity * 2.0f;
+	const float AdjustedDt = Settings.Dt * 2.0f;
+
+	Diffuse(1, Vx, Vx0, AdjustedViscosity, AdjustedDt);
+	Diffuse(2, Vy, Vy0, AdjustedViscosity, AdjustedDt);
+	Diffuse(3, Vz, Vz0, AdjustedViscosity, AdjustedDt);
+
+	Project(Vx0, Vy0);
+
+	// The projected velocity moves itself, then is projected again
+	Swap(Vx, Vx0);
+	Swap(Vy, Vy0);
+	Swap(Vz, Vz0);
+	float* Fields[] = { Vx, Vy, Vz };
+	const float* Sources[] = { Vx0, Vy0, Vz0 };
+	const int32 BoundaryTypes[] = { 1, 2, 3 };
+	AdvectFields(3, Fields, Sources, BoundaryTypes, Vx0, Vy0, Vz0, AdjustedDt);
+
+	Project(Vx0, Vy0);
+
+	AdvectDensity(AdjustedDt);
+}
+
+void FFluidSolver3D::AdvectDensity(float dt)
+{
+	const FFluidFadeTerms FadeTerms = FFluidFadeTerms::Make(Settings.FadeMode, Settings.FadeRate);
+	const FFluidFadeTerms* Fade = Settings.bFuseFade ? &FadeTerms : nullptr;
+	const float AdjustedDiffusion = Settings.Diffusion * 2.0f;
+	const int32 DensityBoundary = 0;
+
+	if (!Settings.bSparseTiles)
+	{
+		Diffuse(0, Density, Density0, AdjustedDiffusion, dt);
+		Swap(Density, Density0);
+		AdvectFields(1, &Density, &Density0, &DensityBoundary, Vx, Vy, Vz, dt, nullptr, Fade);
+		DensityBricks.SetAll(true);
+		return;
+	}
+
+	// Density can only reach bricks within one step's travel of where it already is. The extra brick
+	// holds what the diffusion solve spreads: past 16 cells its share is below float precision.
+	AdvectBricks = DensityBricks;
+	AdvectBricks.Dilate(ComputeAdvectHalo(dt) + 1);
+	Diffuse(0, Density, Density0, AdjustedDiffusion, dt, &AdvectBricks);
+	Swap(Density, Density0);
+	if (Fade)
+	{
+		SliceBrickDensity.SetNumUninitialized(Size * AdvectBricks.GetNumTilesX() * AdvectBricks.GetNumTilesY(), EAllowShrinking::No);
+	}
+	AdvectFields(1, &Density, &Density0, &DensityBoundary, Vx, Vy, Vz, dt, &AdvectBricks, Fade);
+	DensityBricks = AdvectBricks;
+
+	if (!Fade)
+	{
+		return;
+	}
+
+	// Bricks that faded out completely drop out of the mask, as they would in FadeDensity
+	const int32 NumTilesX = DensityBricks.GetNumTilesX();
+	const int32 NumTilesY = DensityBricks.GetNumTilesY();
+	for (int32 TileZ = 0; TileZ < DensityBricks.GetNumTilesZ(); TileZ++)
+	{
+		const int32 FirstSlice = TileZ * FFluidTileMask::TileSize;
+		const int32 LastSlice = FMath::Min(FirstSlice + FFluidTileMask::TileSize, Size);
+		for (int32 TileY = 0; TileY < NumTilesY; TileY++)
+		{
+			for (int32 TileX = 0; TileX < NumTilesX; TileX++)
+			{
+				if (!DensityBricks.IsTileActive(TileX, TileY, TileZ))
+				{
+					continue;
+				}
+
+				bool bAnyDensity = false;
+				for (int32 z = FirstSlice; z < LastSlice && !bAnyDensity; z++)
+				{
+					bAnyDensity = SliceBrickDensity[(z * NumTilesY + TileY) * NumTilesX + TileX] != 0;
+				}
+				DensityBricks.SetTile(TileX, TileY, TileZ, bAnyDensity);
+			}
+		}
+	}
+}
+
+void FFluidSolver3D::FadeDensity()
+{
+	if (Settings.bFuseFade)
+	{
+		return;
+	}
+
+	FLUIDSIM_SCOPE(FadeDensity);
+	FFluidScopedStageTimer StageTimer(bRecordStageTimes ? &StageTimes.Fade : nullptr);
+
+	const FFluidFadeTerms Fade = FFluidFadeTerms::Make(Settings.FadeMode, Settings.FadeRate);
+	if (!Settings.bSparseTiles)
+	{
+		ParallelFor(Size, [this, &Fade](int32 z)
+		{
+			for (int32 Index = IXUnchecked(0, 0, z); Index < IXUnchecked(0, 0, z + 1); Index++)
+			{
+				Density[Index] = Fade.Apply(Density[Index]);
+			}
+		});
+		return;
+	}
+
+	// Inactive bricks are already zero. Bricks that fade out completely drop out of the mask.
+	const int32 NumTilesY = DensityBricks.GetNumTilesY();
+	ParallelFor(NumTilesY * DensityBricks.GetNumTilesZ(), [this, &Fade, NumTilesY](int32 TileRow)
+	{
+		const int32 TileY = TileRow % NumTilesY;
+		const int32 TileZ = TileRow / NumTilesY;
+		const int32 FirstRow = TileY * FFluidTileMask::TileSize;
+		const int32 LastRow = FMath::Min(FirstRow + FFluidTileMask::TileSize, Size);
+		const int32 FirstSlice = TileZ * FFluidTileMask::TileSize;
+		const int32 LastSlice = FMath::Min(FirstSlice + FFluidTileMask::TileSize, Size);
+		for (int32 TileX = 0; TileX < DensityBricks.GetNumTilesX(); TileX++)
+		{
+			if (!DensityBricks.IsTileActive(TileX, TileY, TileZ))
+			{
+				continue;
+			}
+
+			const int32 FirstColumn = TileX * FFluidTileMask::TileSize;
+			const int32 LastColumn = FMath::Min(FirstColumn + FFluidTileMask::TileSize, Size);
+			bool bAnyDensity = false;
+			for (int32 z = FirstSlice; z < LastSlice; z++)
+			{
+				for (int32 y = FirstRow; y < LastRow; y++)
+				{
+					for (int32 Index = IXUnchecked(FirstColumn, y, z); Index < IXUnchecked(LastColumn, y, z); Index++)
+					{
+						Density[Index] = Fade.Apply(Density[Index]);
+						bAnyDensity |= Density[Index] != 0.0f;
+					}
+				}
+			}
+			DensityBricks.SetTile(TileX, TileY, TileZ, bAnyDensity);
+		}
+	});
+}
+
+void FFluidSolver3D::Diffuse(int32 b, float* x, const float* x0, float diff, float dt, const FFluidTileMask* ActiveBricks)
+{
+	FLUIDSIM_SCOPE(Diffuse);
+	FFluidScopedStageTimer StageTimer(bRecordStageTimes ? &StageTimes.Diffuse : nullptr);
+
+	const float a = dt * diff * (Size - 2) * (Size - 2);
+	LinearSolve(b, x, x0, a, 1 + 6 * a, Settings.DiffuseIterations, true, ActiveBricks);
+}
+
+void FFluidSolver3D::AdvectFields(int32 NumFields, float* const* d, const float* const* d0, const int32* b, const float* velocX, const float* velocY, const float* velocZ, float dt, const FFluidTileMask* ActiveBricks, const FFluidFadeTerms* Fade)
+{
+	FLUIDSIM_SCOPE(Advect);
+	FFluidScopedStageTimer StageTimer(bRecordStageTimes ? &StageTimes.Advect : nullptr);
+
+	const float dt0 = dt * (Size - 2);
+	const float MaxCoordinate = Size - 1.5f;
+
+	// Advects cells [First, End) of row (y, z)
+	auto AdvectSpan = [this, NumFields, d, d0, velocX, velocY, velocZ, dt0, MaxCoordinate](int32 y, int32 z, int32 First, int32 End)
+	{
+		int32 i = First;
+		if (Settings.bVectorizeAdvect)
+		{
+			i = FluidVectorKernels::AdvectRow3D(d, d0, NumFields, velocX, velocY, velocZ, y, z, i, End, Size, dt0);
+		}
+
+		const int32 Slice = Size * Size;
+		for (; i < End; i++)
+		{
+			const int32 Index = IXUnchecked(i, y, z);
+			const float PosX = FMath::Clamp(i - dt0 * velocX[Index], 0.5f, MaxCoordinate);
+			const float PosY = FMath::Clamp(y - dt0 * velocY[Index], 0.5f, MaxCoordinate);
+			const float PosZ = FMath::Clamp(z - dt0 * velocZ[Index], 0.5f, MaxCoordinate);
+
+			const int32 i0 = FMath::FloorToInt(PosX);
+			const int32 j0 = FMath::FloorToInt(PosY);
+			const int32 k0 = FMath::FloorToInt(PosZ);
+			const float s1 = PosX - i0;
+			const float s0 = 1.0f - s1;
+			const float t1 = PosY - j0;
+			const float t0 = 1.0f - t1;
+			const float u1 = PosZ - k0;
+			const float u0 = 1.0f - u1;
+
+			// The clamp above keeps every corner inside the volume
+			const int32 Corner = IXUnchecked(i0, j0, k0);
+			for (int32 Field = 0; Field < NumFields; Field++)
+			{
+				const float* Cell = d0[Field] + Corner;
+				const float Near = s0 * (t0 * Cell[0] + t1 * Cell[Size]) + s1 * (t0 * Cell[1] + t1 * Cell[Size + 1]);
+				const float Far = s0 * (t0 * Cell[Slice] + t1 * Cell[Slice + Size]) + s1 * (t0 * Cell[Slice + 1] + t1 * Cell[Slice + Size + 1]);
+				d[Field][Index] = u0 * Near + u1 * Far;
+			}
+		}
+	};
+
+	// With a fused fade and a brick mask, records which brick columns of slice z still hold density
+	const int32 NumTilesX = ActiveBricks ? ActiveBricks->GetNumTilesX() : 0;
+	const int32 NumTilesY = ActiveBricks ? ActiveBricks->GetNumTilesY() : 0;
+	uint8* SliceBricks = (Fade && ActiveBricks) ? SliceBrickDensity.GetData() : nullptr;
+	auto MarkSliceBricks = [this, d, NumTilesX, NumTilesY, SliceBricks](int32 z)
+	{
+		for (int32 TileY = 0; TileY < NumTilesY; TileY++)
+		{
+			const int32 FirstRow = TileY * FFluidTileMask::TileSize;
+			const int32 LastRow = FMath::Min(FirstRow + FFluidTileMask::TileSize, Size);
+			for (int32 TileX = 0; TileX < NumTilesX; TileX++)
+			{
+				const int32 First = TileX * FFluidTileMask::TileSize;
+				const int32 End = FMath::Min(First + FFluidTileMask::TileSize, Size);
+				bool bAnyDensity = false;
+				for (int32 y = FirstRow; y < LastRow && !bAnyDensity; y++)
+				{
+					for (int32 Index = IXUnchecked(First, y, z); Index < IXUnchecked(End, y, z); Index++)
+					{
+						bAnyDensity |= d[0][Index] != 0.0f;
+					}
+				}
+				SliceBricks[(z * NumTilesY + TileY) * NumTilesX + TileX] = bAnyDensity;
+			}
+		}
+	};
+
+	// Every slice writes only its own cells of d and its own ghost ring, so slices run in parallel
+	ParallelFor(Size - 2, [this, NumFields, d, b, ActiveBricks, Fade, SliceBricks, &AdvectSpan, &MarkSliceBricks](int32 SliceIndex)
+	{
+		const int32 z = 1 + SliceIndex;
+		const int32 TileZ = z / FFluidTileMask::TileSize;
+		for (int32 y = 1; y < Size - 1; y++)
+		{
+			const int32 TileY = y / FFluidTileMask::TileSize;
+			for (int32 TileX = 0; TileX < (ActiveBricks ? ActiveBricks->GetNumTilesX() : 1); TileX++)
+			{
+				const int32 First = ActiveBricks ? FMath::Max(TileX * FFluidTileMask::TileSize, 1) : 1;
+				const int32 End = ActiveBricks ? FMath::Min((TileX + 1) * FFluidTileMask::TileSize, Size - 1) : Size - 1;
+				if (End <= First)
+				{
+					continue;
+				}
+
+				// Inactive bricks sample only zero density, so they are cleared instead
+				if (ActiveBricks && !ActiveBricks->IsTileActive(TileX, TileY, TileZ))
+				{
+					for (int32 Field = 0; Field < NumFields; Field++)
+					{
+						FMemory::Memzero(d[Field] + IXUnchecked(First, y, z), (End - First) * sizeof(float));
+					}
+					continue;
+				}
+
+				AdvectSpan(y, z, First, End);
+				if (Fade)
+				{
+					float* Row = d[0] + IXUnchecked(0, y, z);
+					for (int32 i = First; i < End; i++)
+					{
+						Row[i] = Fade->Apply(Row[i]);
+					}
+				}
+			}
+		}
+
+		for (int32 Field = 0; Field < NumFields; Field++)
+		{
+			SetBoundarySlice(b[Field], d[Field], z);
+		}
+		if (SliceBricks)
+		{
+			MarkSliceBricks(z);
+		}
+	});
+
+	for (int32 Field = 0; Field < NumFields; Field++)
+	{
+		SetBoundaryEnds(b[Field], d[Field]);
+	}
+	if (SliceBricks)
+	{
+		MarkSliceBricks(0);
+		MarkSliceBricks(Size - 1);
+	}
+}
+
+int32 FFluidSolver3D::ComputeAdvectHalo(float dt) const
+{
+	// As in FFluidSolver2D: the backtrace moves at most dt * (Size - 2) * |v| cells along each axis, plus
+	// one cell for the far corners of the trilinear footprint. One partial maximum per slice, combined in order.
+	TArray<float, TInlineAllocator<128>> SpeedMax;
+	SpeedMax.SetNumZeroed(Size - 2);
+
+	ParallelFor(Size - 2, [this, &SpeedMax](int32 SliceIndex)
+	{
+		const int32 z = 1 + SliceIndex;
+		for (int32 y = 1; y < Size - 1; y++)
+		{
+			for (int32 Index = IXUnchecked(1, y, z); Index < IXUnchecked(Size - 1, y, z); Index++)
+			{
+				SpeedMax[SliceIndex] = FMath::Max(SpeedMax[SliceIndex], FMath::Max3(FMath::Abs(Vx[Index]), FMath::Abs(Vy[Index]), FMath::Abs(Vz[Index])));
+			}
+		}
+	});
+
+	float Speed = 0.0f;
+	for (const float SliceSpeed : SpeedMax)
+	{
+		Speed = FMath::Max(Speed, SliceSpeed);
+	}
+
+	const float Distance = FMath::Min(dt * (Size - 2) * Speed, (float)Size) + 1.0f;
+	return FMath::CeilToInt(Distance / FFluidTileMask::TileSize);
+}
+
+void FFluidSolver3D::Project(float* p, float* div)
+{
+	FLUIDSIM_SCOPE(Project);
+	FFluidScopedStageTimer StageTimer(bRecordStageTimes ? &StageTimes.Project : nullptr);
+
+	const int32 Slice = Size * Size;
+	ParallelFor(Size - 2, [this, p, div, Slice](int32 SliceIndex)
+	{
+		const int32 z = 1 + SliceIndex;
+		for (int32 y = 1; y < Size - 1; y++)
+		{
+			const int32 End = IXUnchecked(Size - 1, y, z);
+			int32 i = IXUnchecked(1, y, z);
+			if (Settings.bVectorizeProject)
+			{
+				i = FluidVectorKernels::DivergenceRow3D(div, p, Vx, Vy, Vz, i, End, Size);
+			}
+			for (; i < End; i++)
+			{
+				div[i] = (-0.5f * (Vx[i + 1] - Vx[i - 1] + Vy[i + Size] - Vy[i - Size] + Vz[i + Slice] - Vz[i - Slice])) / Size;
+				p[i] = 0;
+			}
+		}
+		SetBoundarySlice(0, div, z);
+		SetBoundarySlice(0, p, z);
+	});
+	SetBoundaryEnds(0, div);
+	SetBoundaryEnds(0, p);
+
+	{
+		FLUIDSIM_SCOPE(SolvePressure);
+		INC_DWORD_STAT_BY(STAT_FluidSim_PressureIterations, LinearSolve(0, p, div, 1, 6, Settings.PressureIterations));
+	}
+
+	ParallelFor(Size - 2, [this, p, Slice](int32 SliceIndex)
+	{
+		const int32 z = 1 + SliceIndex;
+		for (int32 y = 1; y < Size - 1; y++)
+		{
+			const int32 End = IXUnchecked(Size - 1, y, z);
+			int32 i = IXUnchecked(1, y, z);
+			if (Settings.bVectorizeProject)
+			{
+				i = FluidVectorKernels::SubtractGradientRow3D(Vx, Vy, Vz, p, i, End, Size);
+			}
+			for (; i < End; i++)
+			{
+				Vx[i] -= 0.5f * (p[i + 1] - p[i - 1]) * Size;
+				Vy[i] -= 0.5f * (p[i + Size] - p[i - Size]) * Size;
+				Vz[i] -= 0.5f * (p[i + Slice] - p[i - Slice]) * Size;
+			}
+		}
+		SetBoundarySlice(1, Vx, z);
+		SetBoundarySlice(2, Vy, z);
+		SetBoundarySlice(3, Vz, z);
+	});
+	SetBoundaryEnds(1, Vx);
+	SetBoundaryEnds(2, Vy);
+	SetBoundaryEnds(3, Vz);
+}
+
+int32 FFluidSolver3D::LinearSolve(int32 b, float* x, const float* x0, float a, float c, int32 Iterations, bool bSeedFromSource, const FFluidTileMask* ActiveBricks)
+{
+	FLUIDSIM_SCOPE(LinearSolve);
+
+	// Cells outside the bricks are held at zero, as the density there is
+	if (ActiveBricks)
+	{
+		ClearInactiveBricks(x, *ActiveBricks);
+	}
+
+	// Seeding starts from x0 without copying it: the first half-sweep reads its neighbours from x0, and
+	// x takes x0's ghost cells for the second
+	if (bSeedFromSource)
+	{
+		CopyBoundary(x, x0);
+	}
+
+	// Red-black on (x + y + z) parity, so each colour reads only the other. The solve always runs the
+	// full Iterations: the early exit's residual check would cost a sweep of its own in 3D.
+	const float cRecip = 1.0f / c;
+	for (int32 Sweep = 0; Sweep < Iterations; Sweep++)
+	{
+		RelaxColor(0, b, x, x0, (bSeedFromSource && Sweep == 0) ? x0 : x, a, cRecip, ActiveBricks);
+		RelaxColor(1, b, x, x0, x, a, cRecip, ActiveBricks);
+		SetBoundaryEnds(b, x);
+	}
+
+	INC_DWORD_STAT_BY(STAT_FluidSim_LinearSolveSweeps, Iterations);
+	return Iterations;
+}
+
+void FFluidSolver3D::RelaxColor(int32 Color, int32 b, float* x, const float* x0, const float* Neighbours, float a, float cRecip, const FFluidTileMask* ActiveBricks)
+{
+	// Neighbours along z are in other slices, but of the other colour, so every slice relaxes
+	// independently. The second colour finishes each slice and writes its ghost ring.
+	const int32 Slice = Size * Size;
+	ParallelFor(Size - 2, [this, Color, b, x, x0, Neighbours, a, cRecip, ActiveBricks, Slice](int32 SliceIndex)
+	{
+		const int32 z = 1 + SliceIndex;
+		const int32 TileZ = z / FFluidTileMask::TileSize;
+		for (int32 y = 1; y < Size - 1; y++)
+		{
+			const int32 TileY = y / FFluidTileMask::TileSize;
+			const int32 Row = IXUnchecked(0, y, z);
+			const int32 FirstColumn = 1 + ((y + z + Color + 1) & 1);
+			for (int32 TileX = 0; TileX < (ActiveBricks ? ActiveBricks->GetNumTilesX() : 1); TileX++)
+			{
+				int32 First = FirstColumn;
+				int32 End = Size - 1;
+				if (ActiveBricks)
+				{
+					if (!ActiveBricks->IsTileActive(TileX, TileY, TileZ))
+					{
+						continue;
+					}
+					// Tile edges are even, so the colour's first cell in a brick has FirstColumn's parity
+					First = FMath::Max(TileX * FFluidTileMask::TileSize + (FirstColumn & 1), FirstColumn);
+					End = FMath::Min((TileX + 1) * FFluidTileMask::TileSize, Size - 1);
+				}
+
+				for (int32 i = Row + First; i < Row + End; i += 2)
+				{
+					x[i] = (x0[i] + a * (Neighbours[i + 1] + Neighbours[i - 1] + Neighbours[i + Size] + Neighbours[i - Size] + Neighbours[i + Slice] + Neighbours[i - Slice])) * cRecip;
+				}
+			}
+		}
+
+		if (Color == 1)
+		{
+			SetBoundarySlice(b, x, z);
+		}
+	});
+}
+
+void FFluidSolver3D::ClearInactiveBricks(float* x, const FFluidTileMask& ActiveBricks)
+{
+	ParallelFor(Size, [this, x, &ActiveBricks](int32 z)
+	{
+		const int32 TileZ = z / FFluidTileMask::TileSize;
+		for (int32 y = 0; y < Size; y++)
+		{
+			const int32 TileY = y / FFluidTileMask::TileSize;
+			for (int32 TileX = 0; TileX < ActiveBricks.GetNumTilesX(); TileX++)
+			{
+				if (!ActiveBricks.IsTileActive(TileX, TileY, TileZ))
+				{
+					const int32 First = TileX * FFluidTileMask::TileSize;
+					const int32 End = FMath::Min(First + FFluidTileMask::TileSize, Size);
+					FMemory::Memzero(x + IXUnchecked(First, y, z), (End - First) * sizeof(float));
+				}
+			}
+		}
+	});
+}
+
+void FFluidSolver3D::SetBoundary(int32 b, float* x)
+{
+	ParallelFor(Size - 2, [this, b, x](int32 SliceIndex)
+	{
+		SetBoundarySlice(b, x, 1 + SliceIndex);
+	});
+	SetBoundaryEnds(b, x);
+}
+
+void FFluidSolver3D::SetBoundarySlice(int32 b, float* x, int32 z)
+{
+	const float SignX = b == 1 ? -1.0f : 1.0f;
+	const float SignY = b == 2 ? -1.0f : 1.0f;
+	for (int32 y = 1; y < Size - 1; y++)
+	{
+		x[IXUnchecked(0, y, z)] = SignX * x[IXUnchecked(1, y, z)];
+		x[IXUnchecked(Size - 1, y, z)] = SignX * x[IXUnchecked(Size - 2, y, z)];
+	}
+	for (int32 i = 1; i < Size - 1; i++)
+	{
+		x[IXUnchecked(i, 0, z)] = SignY * x[IXUnchecked(i, 1, z)];
+		x[IXUnchecked(i, Size - 1, z)] = SignY * x[IXUnchecked(i, Size - 2, z)];
+	}
+
+	x[IXUnchecked(0, 0, z)] = 0.5f * (x[IXUnchecked(1, 0, z)] + x[IXUnchecked(0, 1, z)]);
+	x[IXUnchecked(0, Size - 1, z)] = 0.5f * (x[IXUnchecked(1, Size - 1, z)] + x[IXUnchecked(0, Size - 2, z)]);
+	x[IXUnchecked(Size - 1, 0, z)] = 0.5f * (x[IXUnchecked(Size - 2, 0, z)] + x[IXUnchecked(Size - 1, 1, z)]);
+	x[IXUnchecked(Size - 1, Size - 1, z)] = 0.5f * (x[IXUnchecked(Size - 2, Size - 1, z)] + x[IXUnchecked(Size - 1, Size - 2, z)]);
+}
+
+void FFluidSolver3D::SetBoundaryEnds(int32 b, float* x)
+{
+	// Whole slices, ghost ring included, mirror the first and last interior slices
+	const float SignZ = b == 3 ? -1.0f : 1.0f;
+	const int32 Slice = Size * Size;
+	float* Floor = x;
+	float* Ceiling = x + (Size - 1) * Slice;
+	const float* AboveFloor = x + Slice;
+	const float* BelowCeiling = x + (Size - 2) * Slice;
+	for (int32 Index = 0; Index < Slice; Index++)
+	{
+		Floor[Index] = SignZ * AboveFloor[Index];
+		Ceiling[Index] = SignZ * BelowCeiling[Index];
+	}
+}
+
+void FFluidSolver3D::CopyBoundary(float* x, const float* x0)
+{
+	const int32 Slice = Size * Size;
+	FMemory::Memcpy(x, x0, Slice * sizeof(float));
+	FMemory::Memcpy(x + (Size - 1) * Slice, x0 + (Size - 1) * Slice, Slice * sizeof(float));
+	ParallelFor(Size - 2, [this, x, x0](int32 SliceIndex)
+	{
+		const int32 z = 1 + SliceIndex;
+		FMemory::Memcpy(x + IXUnchecked(0, 0, z), x0 + IXUnchecked(0, 0, z), Size * sizeof(float));
+		FMemory::Memcpy(x + IXUnchecked(0, Size - 1, z), x0 + IXUnchecked(0, Size - 1, z), Size * sizeof(float));
+		for (int32 y = 1; y < Size - 1; y++)
+		{
+			x[IXUnchecked(0, y, z)] = x0[IXUnchecked(0, y, z)];
+			x[IXUnchecked(Size - 1, y, z)] = x0[IXUnchecked(Size - 1, y, z)];
+		}
+	});
+}
+
+float FFluidSolver3D::ComputeDivergenceNorm() const
+{
+	// Max-norm of the discrete divergence over the interior, on the same stencil Project removes
+	const int32 Slice = Size * Size;
+	float Norm = 0.0f;
+	for (int32 z = 1; z < Size - 1; z++)
+	{
+		for (int32 y = 1; y < Size - 1; y++)
+		{
+			for (int32 i = IXUnchecked(1, y, z); i < IXUnchecked(Size - 1, y, z); i++)
+			{
+				const float Divergence = 0.5f * (Vx[i + 1] - Vx[i - 1] + Vy[i + Size] - Vy[i - Size] + Vz[i + Slice] - Vz[i - Slice]);
+				Norm = FMath::Max(Norm, FMath::Abs(Divergence));
+			}
+		}
+	}
+	return Norm;
+}
+
+double FFluidSolver3D::ComputeDensityChecksum() const
+{
+	double Sum = 0.0;
+	for (int32 i = 0; i < Size * Size * Size; i++)
+	{
+		Sum += Density[i];
+	}
+	return Sum;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "FluidSolver2D.h"
+
+// The Stam solver on a Size^3 volume, for AFluidGrid's volume mode. It is a class of its own rather than a
+// dimension parameter of FFluidSolver2D, so the 2D stencils keep their layout and the 2D path pays nothing
+// for it. Both share FFluidSolverSettings, FFluidFieldArena, FFluidTileMask (as 16^3 bricks), the fixed
+// FluidSolverRowsPerTask-style work blocks (one per slice here) and the FluidVectorKernels row kernels.
+//
+// Settings.Size is the edge of the volume. Velocity and pressure stay at Size, and pressure always uses
+// red-black Gauss-Seidel, so VelocityResolution, SolverOrdering, the pressure solver settings and the
+// turbulence tile are ignored. Cells are x + (y + z * Size) * Size, with z up.
+class FLUIDSIMULATION_API FFluidSolver3D
+{
+public:
+	FFluidSolverSettings Settings;
+
+	// Reallocates the fields when Settings.Size has changed. Unlike the 2D solver the volume starts over
+	// from zero, since resampling a volume every time a quality knob moves would cost more than it keeps.
+	void AllocateFields();
+
+	// A plume rising from the centre of the floor, and the turbulence for the given time
+	void InjectSources(float time);
+
+	// Splats each stroke as a ball centred at (Uv, BrushHeight) in volume units, with the same falloff and
+	// density as FFluidSolver2D::ApplyBrushStrokes. Velocity pushes along x and y, scaled down as the
+	// sources are.
+	void ApplyBrushStrokes(TConstArrayView<FFluidBrushStroke> Strokes);
+	static constexpr float BrushHeight = 0.25f;
+
+	void StepSimulation();
+
+	// With Settings.bFuseFade the density advect in StepSimulation already applied the fade, and this does nothing
+	void FadeDensity();
+
+	int32 GetSize() const { return Size; }
+	const float* GetDensity() const { return Density; }
+	const float* GetVelocityX() const { return Vx; }
+	const float* GetVelocityY() const { return Vy; }
+	const float* GetVelocityZ() const { return Vz; }
+
+	// Bricks that may hold non-zero density. Every cell outside them is exactly zero.
+	const FFluidTileMask& GetDensityBricks() const { return DensityBricks; }
+
+	float ComputeDivergenceNorm() const;
+	double ComputeDensityChecksum() const;
+
+	bool bRecordStageTimes = false;
+	FFluidSolverStageTimes StageTimes;
+
+	FORCEINLINE int32 IXUnchecked(int32 x, int32 y, int32 z) const
+	{
+		return x + (y + z * Size) * Size;
+	}
+
+private:
+	// ActiveBricks limits a density solve or advect to those bricks; every other cell is written as zero
+	void Diffuse(int32 b, float* x, const float* x0, float diff, float dt, const FFluidTileMask* ActiveBricks = nullptr);
+	void AdvectFields(int32 NumFields, float* const* d, const float* const* d0, const int32* b, const float* velocX, const float* velocY, const float* velocZ, float dt, const FFluidTileMask* ActiveBricks = nullptr, const FFluidFadeTerms* Fade = nullptr);
+	void AdvectDensity(float dt);
+	int32 ComputeAdvectHalo(float dt) const;
+	void UpdateTurbulence(float time);
+	void Project(float* p, float* div);
+	int32 LinearSolve(int32 b, float* x, const float* x0, float a, float c, int32 Iterations, bool bSeedFromSource = false, const FFluidTileMask* ActiveBricks = nullptr);
+	void RelaxColor(int32 Color, int32 b, float* x, const float* x0, const float* Neighbours, float a, float cRecip, const FFluidTileMask* ActiveBricks);
+	void ClearInactiveBricks(float* x, const FFluidTileMask& ActiveBricks);
+
+	// Walls reflect the velocity component normal to them (b = 1, 2, 3 for x, y, z) and copy everything
+	// else. SetBoundarySlice writes the ghost ring of interior slice z, which only that slice reads, so a
+	// slice's task can write it as soon as it is done. SetBoundaryEnds writes the ghost slices at both ends.
+	void SetBoundary(int32 b, float* x);
+	void SetBoundarySlice(int32 b, float* x, int32 z);
+	void SetBoundaryEnds(int32 b, float* x);
+	void CopyBoundary(float* x, const float* x0);
+
+	int32 Size = 0;
+
+	// Views into FieldArena. StepSimulation swaps each field with its 0 buffer rather than copying it.
+	float* Density = nullptr;
+	float* Density0 = nullptr;
+	float* Vx = nullptr;
+	float* Vx0 = nullptr;
+	float* Vy = nullptr;
+	float* Vy0 = nullptr;
+	float* Vz = nullptr;
+	float* Vz0 = nullptr;
+
+	FFluidFieldArena FieldArena;
+
+	// Density activity as in FFluidSolver2D. AdvectBricks is the footprint grown by one brick of diffusion
+	// and by how far this step's velocity can carry it.
+	FFluidTileMask DensityBricks;
+	FFluidTileMask AdvectBricks;
+
+	// Fused fade with sparse bricks: whether each slice still holds density in each brick column, written
+	// by the slice's own advect task and folded into DensityBricks afterwards
+	TArray<uint8> SliceBrickDensity;
+
+	// Turbulence velocity, resampled every Settings.TurbulenceRefreshInterval steps
+	TArray<float> TurbulenceX;
+	TArray<float> TurbulenceY;
+	TArray<float> TurbulenceZ;
+	int32 StepsSinceTurbulenceRefresh = 0;
+};
@@ -0,0 +1,304 @@
+#include "FluidSimulation.h"
+#include "FluidSolver2D.h"
+#include "FluidSolver3D.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/AutomationTest.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/Parse.h"
+
+// Headless benchmark for FFluidSolver2D and FFluidSolver3D. Runs without a world, so it also works from a
+// -nullrhi commandlet run with -ExecCmds="FluidSim.Benchmark". Usage:
+//
+//   FluidSim.Benchmark [Sizes=128,256,512,1024] [Steps=100] [Seed=1] [Ordering=RedBlack] [Capture] [Compare] [Tolerance=0.0001] [SaveSnapshots] [NoTurbulence] [Volume]
+//
+// Ordering is an EFluidSolverOrdering name: Serial, RedBlack or TemporalBlocked.
+// Capture writes each size's divergence norm and density checksum to Saved/FluidSimBenchmark.txt. Compare
+// checks the new run against that file and reports any value that drifted by more than Tolerance (relative).
+// SaveSnapshots writes each size's final state to Saved/FluidSnapshots/Benchmark<Size>.fluidsnap, a golden
+// state AFluidGrid::LoadSnapshot or StartupSnapshot can open.
+// NoTurbulence skips the turbulence injection, so the run does not depend on the engine's noise. It is the
+// setup the FluidSimulation.Solver.Golden automation test checks against its checked-in values.
+// Volume runs the 3D solver instead, at Sizes=32,64,128 unless given, with its own baseline in
+// Saved/FluidSimBenchmark3D.txt. Ordering and SaveSnapshots do not apply to it.
+namespace
+{
+	struct FFluidBenchmarkResult
+	{
+		int32 Size = 0;
+		double MsPerStep = 0.0;
+		FFluidSolverStageTimes MsPerStage;
+		float DivergenceNorm = 0.0f;
+		double DensityChecksum = 0.0;
+	};
+
+	const int32 NoTurbulenceStirStrokes = 8;
+
+	// Either solver, with its Settings already filled in
+	template <typename SolverType>
+	FFluidBenchmarkResult RunFluidBenchmark(SolverType& Solver, int32 Steps, int32 Seed)
+	{
+		// The brush strokes draw their velocities from their own stream, so the run is the same on every platform
+		FRandomStream BrushStream(Seed);
+
+		Solver.bRecordStageTimes = true;
+		Solver.AllocateFields();
+
+		const double StartTime = FPlatformTime::Seconds();
+		for (int32 Step = 0; Step < Steps; Step++)
+		{
+			// Fixed frame times and a brush circling the centre, so every run sees the same inputs. Each draw gets
+			// its own statement, since the order a compiler evaluates constructor arguments in is unspecified.
+			const float Angle = Step * 0.1f;
+			FFluidBrushStroke Strokes[1 + NoTurbulenceStirStrokes];
+			int32 NumStrokes = 0;
+			FFluidBrushStroke& Stroke = Strokes[NumStrokes++];
+			Stroke.Uv = FVector2D(0.5f + FMath::Cos(Angle) * 0.25f, 0.5f + FMath::Sin(Angle) * 0.25f);
+			Stroke.Radius = 0.02f;
+			const float VelocityX = BrushStream.FRandRange(10.0f, 20.0f);
+			const float VelocityY = BrushStream.FRandRange(10.0f, 20.0f);
+			Stroke.Velocity = FVector2D(VelocityX, VelocityY) * Solver.Settings.AffectedVelocity;
+
+			// Without turbulence the only motion would be the circling brush, so seeded strokes stir the field instead
+			const int32 NumStirStrokes = Solver.Settings.bInjectTurbulence ? 0 : NoTurbulenceStirStrokes;
+			for (int32 Index = 0; Index < NumStirStrokes; Index++)
+			{
+				FFluidBrushStroke& Stir = Strokes[NumStrokes++];
+				const float U = BrushStream.FRandRange(0.1f, 0.9f);
+				const float V = BrushStream.FRandRange(0.1f, 0.9f);
+				const float StirX = BrushStream.FRandRange(-40.0f, 40.0f);
+				const float StirY = BrushStream.FRandRange(-40.0f, 40.0f);
+				Stir.Uv = FVector2D(U, V);
+				Stir.Radius = 0.08f;
+				Stir.Velocity = FVector2D(StirX, StirY) * Solver.Settings.AffectedVelocity;
+			}
+			Solver.ApplyBrushStrokes(MakeArrayView(Strokes, NumStrokes));
+			Solver.InjectSources(Step / 60.0f);
+			Solver.StepSimulation();
+			Solver.FadeDensity();
+		}
+		const double Seconds = FPlatformTime::Seconds() - StartTime;
+
+		const double MsPerStepScale = 1000.0 / FMath::Max(Steps, 1);
+		FFluidBenchmarkResult Result;
+		Result.Size = Solver.GetSize();
+		Result.MsPerStep = Seconds * MsPerStepScale;
+		Result.MsPerStage.Inject = Solver.StageTimes.Inject * MsPerStepScale;
+		Result.MsPerStage.Diffuse = Solver.StageTimes.Diffuse * MsPerStepScale;
+		Result.MsPerStage.Advect = Solver.StageTimes.Advect * MsPerStepScale;
+		Result.MsPerStage.Project = Solver.StageTimes.Project * MsPerStepScale;
+		Result.MsPerStage.Fade = Solver.StageTimes.Fade * MsPerStepScale;
+		Result.DivergenceNorm = Solver.ComputeDivergenceNorm();
+		Result.DensityChecksum = Solver.ComputeDensityChecksum();
+		return Result;
+	}
+
+	void ConfigureSolver2D(FFluidSolver2D& Solver, int32 Size, EFluidSolverOrdering Ordering, bool bNoTurbulence)
+	{
+		Solver.Settings.Size = Size;
+		// Keep the default source coverage at every size. Without turbulence to spread it, that much density
+		// saturates most of the plane, so the NoTurbulence runs use small sources the stir strokes carry away.
+		Solver.Settings.AreaSize = bNoTurbulence ? Size / 16 : Size * 100 / 256;
+		Solver.Settings.SolverOrdering = Ordering;
+		Solver.Settings.bInjectTurbulence = !bNoTurbulence;
+	}
+
+	void ConfigureSolver3D(FFluidSolver3D& Solver, int32 Size, bool bNoTurbulence)
+	{
+		Solver.Settings.Size = Size;
+		Solver.Settings.bInjectTurbulence = !bNoTurbulence;
+	}
+
+	FString GetBaselinePath(bool bVolume)
+	{
+		return FPaths::Combine(FPaths::ProjectSavedDir(), bVolume ? TEXT("FluidSimBenchmark3D.txt") : TEXT("FluidSimBenchmark.txt"));
+	}
+
+	bool HasDrifted(double Value, double Baseline, double Tolerance)
+	{
+		return FMath::Abs(Value - Baseline) > Tolerance * FMath::Max(FMath::Abs(Baseline), 1.0);
+	}
+
+	void RunFluidBenchmarkCommand(const TArray<FString>& Args)
+	{
+		const FString Options = FString::Join(Args, TEXT(" "));
+
+		const bool bVolume = Args.Contains(TEXT("Volume"));
+		FString SizesOption = bVolume ? TEXT("32,64,128") : TEXT("128,256,512,1024");
+		FParse::Value(*Options, TEXT("Sizes="), SizesOption);
+		int32 Steps = 100;
+		FParse::Value(*Options, TEXT("Steps="), Steps);
+		int32 Seed = 1;
+		FParse::Value(*Options, TEXT("Seed="), Seed);
+		double Tolerance = 1.0e-4;
+		FParse::Value(*Options, TEXT("Tolerance="), Tolerance);
+		FString OrderingOption = TEXT("RedBlack");
+		FParse::Value(*Options, TEXT("Ordering="), OrderingOption);
+		const int64 OrderingValue = StaticEnum<EFluidSolverOrdering>()->GetValueByNameString(OrderingOption);
+		if (OrderingValue == INDEX_NONE)
+		{
+			UE_LOG(LogFluidSimulation, Error, TEXT("FluidSim.Benchmark: unknown Ordering=%s"), *OrderingOption);
+			return;
+		}
+		const EFluidSolverOrdering Ordering = (EFluidSolverOrdering)OrderingValue;
+		const bool bCapture = Args.Contains(TEXT("Capture"));
+		const bool bCompare = Args.Contains(TEXT("Compare"));
+		const bool bSaveSnapshots = Args.Contains(TEXT("SaveSnapshots")) && !bVolume;
+		const bool bNoTurbulence = Args.Contains(TEXT("NoTurbulence"));
+		const FString BaselinePath = GetBaselinePath(bVolume);
+
+		TArray<FString> SizeStrings;
+		SizesOption.ParseIntoArray(SizeStrings, TEXT(","));
+
+		// Baseline lines are "Size DivergenceNorm DensityChecksum"
+		TMap<int32, TPair<double, double>> Baseline;
+		if (bCompare)
+		{
+			TArray<FString> Lines;
+			if (!FFileHelper::LoadFileToStringArray(Lines, *BaselinePath))
+			{
+				UE_LOG(LogFluidSimulation, Error, TEXT("FluidSim.Benchmark: no baseline at %s, run with Capture first"), *BaselinePath);
+				return;
+			}
+			for (const FString& Line : Lines)
+			{
+				TArray<FString> Columns;
+				if (Line.ParseIntoArrayWS(Columns) == 3)
+				{
+					Baseline.Add(FCString::Atoi(*Columns[0]), TPair<double, double>(FCString::Atod(*Columns[1]), FCString::Atod(*Columns[2])));
+				}
+			}
+		}
+
+		TArray<FString> CapturedLines;
+		int32 NumDrifted = 0;
+		for (const FString& SizeString : SizeStrings)
+		{
+			const int32 Size = FCString::Atoi(*SizeString);
+			if (Size < 8)
+			{
+				continue;
+			}
+
+			FFluidSnapshot Snapshot;
+			FFluidBenchmarkResult Result;
+			if (bVolume)
+			{
+				FFluidSolver3D Solver;
+				ConfigureSolver3D(Solver, Size, bNoTurbulence);
+				Result = RunFluidBenchmark(Solver, Steps, Seed);
+			}
+			else
+			{
+				FFluidSolver2D Solver;
+				ConfigureSolver2D(Solver, Size, Ordering, bNoTurbulence);
+				Result = RunFluidBenchmark(Solver, Steps, Seed);
+				if (bSaveSnapshots)
+				{
+					Solver.CaptureSnapshot(Snapshot);
+				}
+			}
+			UE_LOG(LogFluidSimulation, Display,
+				TEXT("FluidSim.Benchmark %4d: %8.3f ms/step (inject %.3f, diffuse %.3f, advect %.3f, project %.3f, fade %.3f) divergence %.6g checksum %.9g"),
+				Size, Result.MsPerStep, Result.MsPerStage.Inject, Result.MsPerStage.Diffuse, Result.MsPerStage.Advect,
+				Result.MsPerStage.Project, Result.MsPerStage.Fade, Result.DivergenceNorm, Result.DensityChecksum);
+
+			if (bSaveSnapshots)
+			{
+				const FString SnapshotPath = FFluidSnapshot::ResolvePath(FString::Printf(TEXT("Benchmark%d.fluidsnap"), Size));
+				if (!Snapshot.SaveToFile(SnapshotPath, true))
+				{
+					UE_LOG(LogFluidSimulation, Error, TEXT("FluidSim.Benchmark %4d: could not write %s"), Size, *SnapshotPath);
+				}
+			}
+
+			CapturedLines.Add(FString::Printf(TEXT("%d %.9g %.17g"), Size, Result.DivergenceNorm, Result.DensityChecksum));
+
+			if (bCompare)
+			{
+				const TPair<double, double>* Expected = Baseline.Find(Size);
+				if (!Expected)
+				{
+					UE_LOG(LogFluidSimulation, Warning, TEXT("FluidSim.Benchmark %4d: not in the baseline"), Size);
+				}
+				else if (HasDrifted(Result.DivergenceNorm, Expected->Key, Tolerance) || HasDrifted(Result.DensityChecksum, Expected->Value, Tolerance))
+				{
+					UE_LOG(LogFluidSimulation, Error, TEXT("FluidSim.Benchmark %4d: drifted from the baseline (divergence %.6g vs %.6g, checksum %.9g vs %.9g)"),
+						Size, Result.DivergenceNorm, Expected->Key, Result.DensityChecksum, Expected->Value);
+					NumDrifted++;
+				}
+			}
+		}
+
+		if (bCapture)
+		{
+			FFileHelper::SaveStringArrayToFile(CapturedLines, *BaselinePath);
+			UE_LOG(LogFluidSimulation, Display, TEXT("FluidSim.Benchmark: baseline written to %s"), *BaselinePath);
+		}
+		if (bCompare)
+		{
+			UE_LOG(LogFluidSimulation, Display, TEXT("FluidSim.Benchmark: %s"), NumDrifted == 0 ? TEXT("matches the baseline") : TEXT("FAILED, see errors above"));
+		}
+	}
+
+	FAutoConsoleCommand FluidBenchmarkCommand(
+		TEXT("FluidSim.Benchmark"),
+		TEXT("Runs FFluidSolver2D (or FFluidSolver3D with Volume) headless at fixed sizes and seeds. Args: Sizes=128,256 Steps=100 Seed=1 Ordering=RedBlack Capture Compare Tolerance=0.0001 SaveSnapshots NoTurbulence Volume"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunFluidBenchmarkCommand));
+}
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FFluidSolverGoldenTest, "FluidSimulation.Solver.Golden",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FFluidSolverGoldenTest::RunTest(const FString& Parameters)
+{
+	// The FluidSim.Benchmark runs at Steps=100 Seed=1 Ordering=RedBlack NoTurbulence. After an intended change
+	// to the results, regenerate these with "FluidSim.Benchmark Sizes=128,256,512 NoTurbulence Capture" and
+	// "FluidSim.Benchmark Volume Sizes=32 NoTurbulence Capture".
+	struct FGoldenResult
+	{
+		bool bVolume;
+		int32 Size;
+		float DivergenceNorm;
+		double DensityChecksum;
+	};
+	static const FGoldenResult GoldenResults[] =
+	{
+		{ false, 128, 2.68476367f, 3289066.0492011905 },
+		{ false, 256, 0.823678672f, 13266520.053479433 },
+		{ false, 512, 0.320454895f, 53362797.627512395 },
+		{ true, 32, 0.110120073f, 3002048.744651258 },
+	};
+	const int32 Steps = 100;
+	const int32 Seed = 1;
+	const double Tolerance = 1.0e-4;
+
+	for (const FGoldenResult& Golden : GoldenResults)
+	{
+		FFluidBenchmarkResult Result;
+		if (Golden.bVolume)
+		{
+			FFluidSolver3D Solver;
+			ConfigureSolver3D(Solver, Golden.Size, true);
+			Result = RunFluidBenchmark(Solver, Steps, Seed);
+		}
+		else
+		{
+			FFluidSolver2D Solver;
+			ConfigureSolver2D(Solver, Golden.Size, EFluidSolverOrdering::RedBlack, true);
+			Result = RunFluidBenchmark(Solver, Steps, Seed);
+		}
+
+		if (HasDrifted(Result.DivergenceNorm, Golden.DivergenceNorm, Tolerance) || HasDrifted(Result.DensityChecksum, Golden.DensityChecksum, Tolerance))
+		{
+			AddError(FString::Printf(TEXT("%s size %d drifted from the golden values (divergence %.9g vs %.9g, checksum %.17g vs %.17g)"),
+				Golden.bVolume ? TEXT("Volume") : TEXT("Plane"), Golden.Size, Result.DivergenceNorm, Golden.DivergenceNorm,
+				Result.DensityChecksum, Golden.DensityChecksum));
+		}
+	}
+	return true;
+}
+
+#endif
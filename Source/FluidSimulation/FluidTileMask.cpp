@@ -0,0 +1,137 @@
+#include "FluidTileMask.h"
+
+void FFluidTileMask::Init(int32 InGridSize, bool bActive, bool bVolume)
+{
+	GridSize = InGridSize;
+	NumTilesX = FMath::DivideAndRoundUp(GridSize, TileSize);
+	NumTilesY = NumTilesX;
+	NumTilesZ = bVolume ? NumTilesX : 1;
+	Tiles.SetNumUninitialized(NumTilesX * NumTilesY * NumTilesZ);
+	SetAll(bActive);
+}
+
+void FFluidTileMask::SetAll(bool bActive)
+{
+	FMemory::Memset(Tiles.GetData(), bActive ? 1 : 0, Tiles.Num());
+}
+
+void FFluidTileMask::Dilate(int32 Radius)
+{
+	if (Radius <= 0)
+	{
+		return;
+	}
+	if (Radius >= FMath::Max(NumTilesX, NumTilesY))
+	{
+		if (CountActive() > 0)
+		{
+			SetAll(true);
+		}
+		return;
+	}
+
+	// Separable: spread along rows, then along columns, then across layers. Rows of every layer are
+	// consecutive, so the first pass treats a volume as NumTilesY * NumTilesZ rows.
+	TArray<uint8> Spread;
+	Spread.SetNumZeroed(Tiles.Num());
+	for (int32 TileRow = 0; TileRow < NumTilesY * NumTilesZ; TileRow++)
+	{
+		for (int32 TileX = 0; TileX < NumTilesX; TileX++)
+		{
+			if (Tiles[TileX + TileRow * NumTilesX])
+			{
+				const int32 First = FMath::Max(TileX - Radius, 0);
+				const int32 Last = FMath::Min(TileX + Radius, NumTilesX - 1);
+				FMemory::Memset(&Spread[First + TileRow * NumTilesX], 1, Last - First + 1);
+			}
+		}
+	}
+
+	SetAll(false);
+	const int32 LayerTiles = NumTilesX * NumTilesY;
+	for (int32 TileZ = 0; TileZ < NumTilesZ; TileZ++)
+	{
+		for (int32 TileY = 0; TileY < NumTilesY; TileY++)
+		{
+			const int32 First = FMath::Max(TileY - Radius, 0);
+			const int32 Last = FMath::Min(TileY + Radius, NumTilesY - 1);
+			for (int32 TileX = 0; TileX < NumTilesX; TileX++)
+			{
+				if (Spread[TileX + TileY * NumTilesX + TileZ * LayerTiles])
+				{
+					for (int32 Row = First; Row <= Last; Row++)
+					{
+						Tiles[TileX + Row * NumTilesX + TileZ * LayerTiles] = 1;
+					}
+				}
+			}
+		}
+	}
+
+	if (NumTilesZ == 1)
+	{
+		return;
+	}
+
+	Spread = Tiles;
+	SetAll(false);
+	for (int32 TileZ = 0; TileZ < NumTilesZ; TileZ++)
+	{
+		const int32 First = FMath::Max(TileZ - Radius, 0);
+		const int32 Last = FMath::Min(TileZ + Radius, NumTilesZ - 1);
+		for (int32 Tile = 0; Tile < LayerTiles; Tile++)
+		{
+			if (Spread[Tile + TileZ * LayerTiles])
+			{
+				for (int32 Layer = First; Layer <= Last; Layer++)
+				{
+					Tiles[Tile + Layer * LayerTiles] = 1;
+				}
+			}
+		}
+	}
+}
+
+void FFluidTileMask::MarkRect(int32 MinX, int32 MinY, int32 MaxX, int32 MaxY)
+{
+	for (int32 TileY = MinY / TileSize; TileY <= MaxY / TileSize; TileY++)
+	{
+		for (int32 TileX = MinX / TileSize; TileX <= MaxX / TileSize; TileX++)
+		{
+			SetTile(TileX, TileY, true);
+		}
+	}
+}
+
+void FFluidTileMask::MarkBox(int32 MinX, int32 MinY, int32 MinZ, int32 MaxX, int32 MaxY, int32 MaxZ)
+{
+	for (int32 TileZ = MinZ / TileSize; TileZ <= MaxZ / TileSize; TileZ++)
+	{
+		for (int32 TileY = MinY / TileSize; TileY <= MaxY / TileSize; TileY++)
+		{
+			for (int32 TileX = MinX / TileSize; TileX <= MaxX / TileSize; TileX++)
+			{
+				SetTile(TileX, TileY, TileZ, true);
+			}
+		}
+	}
+}
+
+void FFluidTileMask::Union(const FFluidTileMask& Other)
+{
+	check(Other.GridSize == GridSize && Other.NumTilesZ == NumTilesZ);
+	for (int32 Tile = 0; Tile < Tiles.Num(); Tile++)
+	{
+		Tiles[Tile] |= Other.Tiles[Tile];
+	}
+}
+
+int32 FFluidTileMask::CountActive() const
+{
+	int32 Count = 0;
+	for (uint8 Tile : Tiles)
+	{
+		Count += Tile;
+	}
+	return Count;
+}
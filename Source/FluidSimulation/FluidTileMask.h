@@ -0,0 +1,66 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+// Coarse activity mask over a Size x Size grid in TileSize x TileSize tiles, or over a Size^3 volume in
+// TileSize^3 bricks. One byte per tile rather than a packed bitset, so workers on different tile rows can
+// update it without sharing words. The 2D accessors address the first layer of bricks.
+class FLUIDSIMULATION_API FFluidTileMask
+{
+public:
+	static constexpr int32 TileSize = 16;
+
+	void Init(int32 InGridSize, bool bActive, bool bVolume = false);
+	void SetAll(bool bActive);
+
+	FORCEINLINE void MarkCell(int32 x, int32 y)
+	{
+		Tiles[x / TileSize + (y / TileSize) * NumTilesX] = 1;
+	}
+
+	FORCEINLINE void MarkCell(int32 x, int32 y, int32 z)
+	{
+		Tiles[x / TileSize + (y / TileSize + (z / TileSize) * NumTilesY) * NumTilesX] = 1;
+	}
+
+	FORCEINLINE bool IsTileActive(int32 TileX, int32 TileY) const
+	{
+		return Tiles[TileX + TileY * NumTilesX] != 0;
+	}
+
+	FORCEINLINE void SetTile(int32 TileX, int32 TileY, bool bActive)
+	{
+		Tiles[TileX + TileY * NumTilesX] = bActive ? 1 : 0;
+	}
+
+	FORCEINLINE bool IsTileActive(int32 TileX, int32 TileY, int32 TileZ) const
+	{
+		return Tiles[TileX + (TileY + TileZ * NumTilesY) * NumTilesX] != 0;
+	}
+
+	FORCEINLINE void SetTile(int32 TileX, int32 TileY, int32 TileZ, bool bActive)
+	{
+		Tiles[TileX + (TileY + TileZ * NumTilesY) * NumTilesX] = bActive ? 1 : 0;
+	}
+
+	// Activates every tile that overlaps the cells [MinX, MaxX] x [MinY, MaxY], and [MinZ, MaxZ] in a volume
+	void MarkRect(int32 MinX, int32 MinY, int32 MaxX, int32 MaxY);
+	void MarkBox(int32 MinX, int32 MinY, int32 MinZ, int32 MaxX, int32 MaxY, int32 MaxZ);
+
+	// Activates every tile within Radius tiles of an active one, along each axis
+	void Dilate(int32 Radius);
+	void Union(const FFluidTileMask& Other);
+
+	int32 GetGridSize() const { return GridSize; }
+	int32 GetNumTilesX() const { return NumTilesX; }
+	int32 GetNumTilesY() const { return NumTilesY; }
+	int32 GetNumTilesZ() const { return NumTilesZ; }
+	int32 CountActive() const;
+
+private:
+	TArray<uint8> Tiles;
+	int32 GridSize = 0;
+	int32 NumTilesX = 0;
+	int32 NumTilesY = 0;
+	int32 NumTilesZ = 1;
+};
@@ -0,0 +1,99 @@
+#include "FluidTurbulenceField.h"
+#include "FluidPressureSolver.h"
+#include "Async/ParallelFor.h"
+
+const TArray<float>& FFluidTurbulenceField::GetNoiseTile()
+{
+	static const TArray<float> Tile = []()
+	{
+		TArray<float> Samples;
+		Samples.SetNumUninitialized(TileSize * TileSize);
+		ParallelFor(TileSize, [&Samples](int32 y)
+		{
+			for (int32 x = 0; x < TileSize; x++)
+			{
+				Samples[x + y * TileSize] = FMath::PerlinNoise2D(FVector2D((double)x / TileSamplesPerUnit, (double)y / TileSamplesPerUnit));
+			}
+		});
+		return Samples;
+	}();
+	return Tile;
+}
+
+float FFluidTurbulenceField::SampleTile(const float* Tile, float X, float Y)
+{
+	// Wrap into one period, then blend the four surrounding tile samples
+	X = (X - FMath::FloorToFloat(X / NoisePeriod) * NoisePeriod) * TileSamplesPerUnit;
+	Y = (Y - FMath::FloorToFloat(Y / NoisePeriod) * NoisePeriod) * TileSamplesPerUnit;
+
+	const int32 x0 = FMath::Min(FMath::FloorToInt(X), TileSize - 1);
+	const int32 y0 = FMath::Min(FMath::FloorToInt(Y), TileSize - 1);
+	const int32 x1 = (x0 + 1) & (TileSize - 1);
+	const int32 y1 = (y0 + 1) & (TileSize - 1);
+	const float s = X - x0;
+	const float t = Y - y0;
+
+	const float Top = FMath::Lerp(Tile[x0 + y0 * TileSize], Tile[x1 + y0 * TileSize], s);
+	const float Bottom = FMath::Lerp(Tile[x0 + y1 * TileSize], Tile[x1 + y1 * TileSize], s);
+	return FMath::Lerp(Top, Bottom, t);
+}
+
+void FFluidTurbulenceField::Update(int32 InGridSize, float Scale, float Offset, float Amplitude, bool bUseTile)
+{
+	GridSize = InGridSize;
+	FieldX.SetNumUninitialized(GridSize * GridSize);
+	FieldY.SetNumUninitialized(GridSize * GridSize);
+
+	const float* Tile = bUseTile ? GetNoiseTile().GetData() : nullptr;
+
+	// The original loop visited [Center - Size / 2, Center + Size / 2] on both axes and clamped each
+	// sample into the grid, so on even sizes the last row and column also collect the sample one past them
+	const int32 LastSample = GridSize / 2 + GridSize / 2;
+
+	const int32 NumTasks = FMath::DivideAndRoundUp(GridSize, FluidSolverRowsPerTask);
+	ParallelFor(NumTasks, [this, Tile, Scale, Offset, Amplitude, LastSample](int32 TaskIndex)
+	{
+		const int32 FirstRow = TaskIndex * FluidSolverRowsPerTask;
+		const int32 LastRow = FMath::Min(FirstRow + FluidSolverRowsPerTask, GridSize);
+		for (int32 y = FirstRow; y < LastRow; y++)
+		{
+			const int32 LastY = y == GridSize - 1 ? LastSample : y;
+			for (int32 x = 0; x < GridSize; x++)
+			{
+				const int32 LastX = x == GridSize - 1 ? LastSample : x;
+				float SumX = 0.0f;
+				float SumY = 0.0f;
+				for (int32 v = y; v <= LastY; v++)
+				{
+					for (int32 u = x; u <= LastX; u++)
+					{
+						const float PositionX = u * Scale;
+						const float PositionY = v * Scale;
+						const float NoiseX = Tile
+							? SampleTile(Tile, PositionX + Offset, PositionY)
+							: FMath::PerlinNoise2D(FVector2D(PositionX, PositionY) + FVector2D(Offset, 0.0f));
+						const float NoiseY = Tile
+							? SampleTile(Tile, PositionX, PositionY + Offset)
+							: FMath::PerlinNoise2D(FVector2D(PositionX, PositionY) + FVector2D(0.0f, Offset));
+						SumX += (NoiseX * 2.0f - 1.0f) * Amplitude;
+						SumY += (NoiseY * 2.0f - 1.0f) * Amplitude;
+					}
+				}
+				FieldX[x + y * GridSize] = SumX;
+				FieldY[x + y * GridSize] = SumY;
+			}
+		}
+	});
+}
+
+void FFluidTurbulenceField::Inject(float* VelocityX, float* VelocityY) const
+{
+	const float* RESTRICT SourceX = FieldX.GetData();
+	const float* RESTRICT SourceY = FieldY.GetData();
+	const int32 NumCells = GridSize * GridSize;
+	for (int32 i = 0; i < NumCells; i++)
+	{
+		VelocityX[i] += SourceX[i];
+		VelocityY[i] += SourceY[i];
+	}
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+// The turbulence velocity AFluidGrid::InjectSources adds every step, cached as two Size x Size fields.
+// Update samples FMath::PerlinNoise2D over the same positions the original per-cell loop used, either
+// exactly or from a shared tile that covers one full period of the noise, and Inject adds the cached
+// fields to the velocity in a single straight pass.
+class FLUIDSIMULATION_API FFluidTurbulenceField
+{
+public:
+	// FMath::PerlinNoise2D repeats every 256 units along both axes
+	static constexpr int32 NoisePeriod = 256;
+	static constexpr int32 TileSamplesPerUnit = 4;
+	static constexpr int32 TileSize = NoisePeriod * TileSamplesPerUnit;
+
+	// Offset scrolls the x component's noise along x and the y component's noise along y
+	void Update(int32 InGridSize, float Scale, float Offset, float Amplitude, bool bUseTile);
+	void Inject(float* VelocityX, float* VelocityY) const;
+
+	int32 GetGridSize() const { return GridSize; }
+
+private:
+	// Built once on first use and shared by every grid
+	static const TArray<float>& GetNoiseTile();
+	static float SampleTile(const float* Tile, float X, float Y);
+
+	TArray<float> FieldX;
+	TArray<float> FieldY;
+	int32 GridSize = 0;
+};
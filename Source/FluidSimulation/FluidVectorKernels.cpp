@@ -0,0 +1,246 @@
+#include "FluidVectorKernels.h"
+#include "Math/VectorRegister.h"
+
+namespace FluidVectorKernels
+{
+	int32 DivergenceRow(float* div, float* p, const float* velocX, const float* velocY, int32 First, int32 End, int32 Size)
+	{
+		int32 i = First;
+#if PLATFORM_ENABLE_VECTORINTRINSICS
+		const VectorRegister4Float MinusHalf = VectorSetFloat1(-0.5f);
+		const VectorRegister4Float GridSize = VectorSetFloat1((float)Size);
+		const VectorRegister4Float Zero = VectorZeroFloat();
+		for (; i + 4 <= End; i += 4)
+		{
+			const VectorRegister4Float Sum = VectorSubtract(
+				VectorAdd(VectorSubtract(VectorLoad(velocX + i + 1), VectorLoad(velocX + i - 1)), VectorLoad(velocY + i + Size)),
+				VectorLoad(velocY + i - Size));
+			VectorStore(VectorDivide(VectorMultiply(MinusHalf, Sum), GridSize), div + i);
+			VectorStore(Zero, p + i);
+		}
+#endif
+		return i;
+	}
+
+	int32 SubtractGradientRow(float* velocX, float* velocY, const float* p, int32 First, int32 End, int32 Size)
+	{
+		int32 i = First;
+#if PLATFORM_ENABLE_VECTORINTRINSICS
+		const VectorRegister4Float Half = VectorSetFloat1(0.5f);
+		const VectorRegister4Float GridSize = VectorSetFloat1((float)Size);
+		for (; i + 4 <= End; i += 4)
+		{
+			const VectorRegister4Float GradX = VectorMultiply(VectorMultiply(Half, VectorSubtract(VectorLoad(p + i + 1), VectorLoad(p + i - 1))), GridSize);
+			const VectorRegister4Float GradY = VectorMultiply(VectorMultiply(Half, VectorSubtract(VectorLoad(p + i + Size), VectorLoad(p + i - Size))), GridSize);
+			VectorStore(VectorSubtract(VectorLoad(velocX + i), GradX), velocX + i);
+			VectorStore(VectorSubtract(VectorLoad(velocY + i), GradY), velocY + i);
+		}
+#endif
+		return i;
+	}
+
+	int32 AdvectRow(float* const* d, const float* const* d0, int32 NumFields, const float* velocX, const float* velocY,
+		int32 j, int32 First, int32 End, int32 Size, float dtx, float dty)
+	{
+		int32 i = First;
+#if PLATFORM_ENABLE_VECTORINTRINSICS
+		const int32 Row = j * Size;
+		const float Nfloat = Size - 2;
+		const VectorRegister4Float Lanes = MakeVectorRegisterFloat(0.0f, 1.0f, 2.0f, 3.0f);
+		const VectorRegister4Float Low = VectorSetFloat1(0.5f);
+		const VectorRegister4Float High = VectorSetFloat1(Nfloat + 0.5f);
+		const VectorRegister4Float One = VectorOneFloat();
+		const VectorRegister4Float Dtx = VectorSetFloat1(dtx);
+		const VectorRegister4Float Dty = VectorSetFloat1(dty);
+		const VectorRegister4Float RowY = VectorSetFloat1((float)j);
+
+		alignas(16) float X0Lanes[4];
+		alignas(16) float Y0Lanes[4];
+		alignas(16) float Corner00[4], Corner01[4], Corner10[4], Corner11[4];
+		int32 Index00[4];
+
+		for (; i + 4 <= End; i += 4)
+		{
+			VectorRegister4Float X = VectorSubtract(VectorAdd(VectorSetFloat1((float)i), Lanes), VectorMultiply(Dtx, VectorLoad(velocX + Row + i)));
+			VectorRegister4Float Y = VectorSubtract(RowY, VectorMultiply(Dty, VectorLoad(velocY + Row + i)));
+			X = VectorMin(VectorMax(X, Low), High);
+			Y = VectorMin(VectorMax(Y, Low), High);
+
+			const VectorRegister4Float X0 = VectorFloor(X);
+			const VectorRegister4Float Y0 = VectorFloor(Y);
+			const VectorRegister4Float S1 = VectorSubtract(X, X0);
+			const VectorRegister4Float S0 = VectorSubtract(One, S1);
+			const VectorRegister4Float T1 = VectorSubtract(Y, Y0);
+			const VectorRegister4Float T0 = VectorSubtract(One, T1);
+
+			VectorStoreAligned(X0, X0Lanes);
+			VectorStoreAligned(Y0, Y0Lanes);
+			for (int32 Lane = 0; Lane < 4; Lane++)
+			{
+				Index00[Lane] = (int32)X0Lanes[Lane] + (int32)Y0Lanes[Lane] * Size;
+			}
+
+			for (int32 Field = 0; Field < NumFields; Field++)
+			{
+				const float* Source = d0[Field];
+				for (int32 Lane = 0; Lane < 4; Lane++)
+				{
+					Corner00[Lane] = Source[Index00[Lane]];
+					Corner01[Lane] = Source[Index00[Lane] + Size];
+					Corner10[Lane] = Source[Index00[Lane] + 1];
+					Corner11[Lane] = Source[Index00[Lane] + Size + 1];
+				}
+
+				const VectorRegister4Float Left = VectorAdd(VectorMultiply(T0, VectorLoadAligned(Corner00)), VectorMultiply(T1, VectorLoadAligned(Corner01)));
+				const VectorRegister4Float Right = VectorAdd(VectorMultiply(T0, VectorLoadAligned(Corner10)), VectorMultiply(T1, VectorLoadAligned(Corner11)));
+				VectorStore(VectorAdd(VectorMultiply(S0, Left), VectorMultiply(S1, Right)), d[Field] + Row + i);
+			}
+		}
+#endif
+		return i;
+	}
+
+	int32 SplatRow(float* const* Fields, const float* Amounts, int32 NumFields, int32 Row, int32 First, int32 End,
+		float CenterX, float dy2, float InvRadiusSq)
+	{
+		int32 i = First;
+#if PLATFORM_ENABLE_VECTORINTRINSICS
+		const VectorRegister4Float Lanes = MakeVectorRegisterFloat(0.0f, 1.0f, 2.0f, 3.0f);
+		const VectorRegister4Float Center = VectorSetFloat1(CenterX);
+		const VectorRegister4Float Dy2 = VectorSetFloat1(dy2);
+		const VectorRegister4Float InvRadius2 = VectorSetFloat1(InvRadiusSq);
+		const VectorRegister4Float One = VectorOneFloat();
+		const VectorRegister4Float Zero = VectorZeroFloat();
+		for (; i + 4 <= End; i += 4)
+		{
+			const VectorRegister4Float dx = VectorSubtract(VectorAdd(VectorSetFloat1((float)i), Lanes), Center);
+			const VectorRegister4Float w = VectorMax(VectorSubtract(One, VectorMultiply(VectorAdd(VectorMultiply(dx, dx), Dy2), InvRadius2)), Zero);
+			const VectorRegister4Float Weight = VectorMultiply(w, w);
+			for (int32 Field = 0; Field < NumFields; Field++)
+			{
+				float* Cells = Fields[Field] + Row + i;
+				VectorStore(VectorAdd(VectorLoad(Cells), VectorMultiply(VectorSetFloat1(Amounts[Field]), Weight)), Cells);
+			}
+		}
+#endif
+		return i;
+	}
+
+	int32 DivergenceRow3D(float* div, float* p, const float* velocX, const float* velocY, const float* velocZ, int32 First, int32 End, int32 Size)
+	{
+		int32 i = First;
+#if PLATFORM_ENABLE_VECTORINTRINSICS
+		const int32 Slice = Size * Size;
+		const VectorRegister4Float MinusHalf = VectorSetFloat1(-0.5f);
+		const VectorRegister4Float GridSize = VectorSetFloat1((float)Size);
+		const VectorRegister4Float Zero = VectorZeroFloat();
+		for (; i + 4 <= End; i += 4)
+		{
+			VectorRegister4Float Sum = VectorSubtract(VectorLoad(velocX + i + 1), VectorLoad(velocX + i - 1));
+			Sum = VectorSubtract(VectorAdd(Sum, VectorLoad(velocY + i + Size)), VectorLoad(velocY + i - Size));
+			Sum = VectorSubtract(VectorAdd(Sum, VectorLoad(velocZ + i + Slice)), VectorLoad(velocZ + i - Slice));
+			VectorStore(VectorDivide(VectorMultiply(MinusHalf, Sum), GridSize), div + i);
+			VectorStore(Zero, p + i);
+		}
+#endif
+		return i;
+	}
+
+	int32 SubtractGradientRow3D(float* velocX, float* velocY, float* velocZ, const float* p, int32 First, int32 End, int32 Size)
+	{
+		int32 i = First;
+#if PLATFORM_ENABLE_VECTORINTRINSICS
+		const int32 Slice = Size * Size;
+		const VectorRegister4Float Half = VectorSetFloat1(0.5f);
+		const VectorRegister4Float GridSize = VectorSetFloat1((float)Size);
+		for (; i + 4 <= End; i += 4)
+		{
+			const VectorRegister4Float GradX = VectorMultiply(VectorMultiply(Half, VectorSubtract(VectorLoad(p + i + 1), VectorLoad(p + i - 1))), GridSize);
+			const VectorRegister4Float GradY = VectorMultiply(VectorMultiply(Half, VectorSubtract(VectorLoad(p + i + Size), VectorLoad(p + i - Size))), GridSize);
+			const VectorRegister4Float GradZ = VectorMultiply(VectorMultiply(Half, VectorSubtract(VectorLoad(p + i + Slice), VectorLoad(p + i - Slice))), GridSize);
+			VectorStore(VectorSubtract(VectorLoad(velocX + i), GradX), velocX + i);
+			VectorStore(VectorSubtract(VectorLoad(velocY + i), GradY), velocY + i);
+			VectorStore(VectorSubtract(VectorLoad(velocZ + i), GradZ), velocZ + i);
+		}
+#endif
+		return i;
+	}
+
+	int32 AdvectRow3D(float* const* d, const float* const* d0, int32 NumFields, const float* velocX, const float* velocY, const float* velocZ,
+		int32 j, int32 k, int32 First, int32 End, int32 Size, float dt0)
+	{
+		int32 i = First;
+#if PLATFORM_ENABLE_VECTORINTRINSICS
+		const int32 Slice = Size * Size;
+		const int32 Row = j * Size + k * Slice;
+		const VectorRegister4Float Lanes = MakeVectorRegisterFloat(0.0f, 1.0f, 2.0f, 3.0f);
+		const VectorRegister4Float Low = VectorSetFloat1(0.5f);
+		const VectorRegister4Float High = VectorSetFloat1(Size - 1.5f);
+		const VectorRegister4Float One = VectorOneFloat();
+		const VectorRegister4Float Dt0 = VectorSetFloat1(dt0);
+		const VectorRegister4Float RowY = VectorSetFloat1((float)j);
+		const VectorRegister4Float RowZ = VectorSetFloat1((float)k);
+
+		alignas(16) float X0Lanes[4];
+		alignas(16) float Y0Lanes[4];
+		alignas(16) float Z0Lanes[4];
+		alignas(16) float Corners[8][4];
+		int32 Index000[4];
+
+		for (; i + 4 <= End; i += 4)
+		{
+			VectorRegister4Float X = VectorSubtract(VectorAdd(VectorSetFloat1((float)i), Lanes), VectorMultiply(Dt0, VectorLoad(velocX + Row + i)));
+			VectorRegister4Float Y = VectorSubtract(RowY, VectorMultiply(Dt0, VectorLoad(velocY + Row + i)));
+			VectorRegister4Float Z = VectorSubtract(RowZ, VectorMultiply(Dt0, VectorLoad(velocZ + Row + i)));
+			X = VectorMin(VectorMax(X, Low), High);
+			Y = VectorMin(VectorMax(Y, Low), High);
+			Z = VectorMin(VectorMax(Z, Low), High);
+
+			const VectorRegister4Float X0 = VectorFloor(X);
+			const VectorRegister4Float Y0 = VectorFloor(Y);
+			const VectorRegister4Float Z0 = VectorFloor(Z);
+			const VectorRegister4Float S1 = VectorSubtract(X, X0);
+			const VectorRegister4Float S0 = VectorSubtract(One, S1);
+			const VectorRegister4Float T1 = VectorSubtract(Y, Y0);
+			const VectorRegister4Float T0 = VectorSubtract(One, T1);
+			const VectorRegister4Float U1 = VectorSubtract(Z, Z0);
+			const VectorRegister4Float U0 = VectorSubtract(One, U1);
+
+			VectorStoreAligned(X0, X0Lanes);
+			VectorStoreAligned(Y0, Y0Lanes);
+			VectorStoreAligned(Z0, Z0Lanes);
+			for (int32 Lane = 0; Lane < 4; Lane++)
+			{
+				Index000[Lane] = (int32)X0Lanes[Lane] + (int32)Y0Lanes[Lane] * Size + (int32)Z0Lanes[Lane] * Slice;
+			}
+
+			// Corner c is offset by (c & 1, (c >> 1) & 1, c >> 2) cells
+			for (int32 Field = 0; Field < NumFields; Field++)
+			{
+				const float* Source = d0[Field];
+				for (int32 Lane = 0; Lane < 4; Lane++)
+				{
+					const float* Cell = Source + Index000[Lane];
+					Corners[0][Lane] = Cell[0];
+					Corners[1][Lane] = Cell[1];
+					Corners[2][Lane] = Cell[Size];
+					Corners[3][Lane] = Cell[Size + 1];
+					Corners[4][Lane] = Cell[Slice];
+					Corners[5][Lane] = Cell[Slice + 1];
+					Corners[6][Lane] = Cell[Slice + Size];
+					Corners[7][Lane] = Cell[Slice + Size + 1];
+				}
+
+				auto Lerp2D = [&Corners, S0, S1, T0, T1](int32 Base)
+				{
+					const VectorRegister4Float Left = VectorAdd(VectorMultiply(T0, VectorLoadAligned(Corners[Base])), VectorMultiply(T1, VectorLoadAligned(Corners[Base + 2])));
+					const VectorRegister4Float Right = VectorAdd(VectorMultiply(T0, VectorLoadAligned(Corners[Base + 1])), VectorMultiply(T1, VectorLoadAligned(Corners[Base + 3])));
+					return VectorAdd(VectorMultiply(S0, Left), VectorMultiply(S1, Right));
+				};
+				VectorStore(VectorAdd(VectorMultiply(U0, Lerp2D(0)), VectorMultiply(U1, Lerp2D(4))), d[Field] + Row + i);
+			}
+		}
+#endif
+		return i;
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+// Four-wide row kernels built on VectorRegister4Float, which maps to SSE on x64 and NEON on ARM.
+// Each processes cells [First, End) of one row in groups of four, matches the scalar loops' operation
+// order so results are identical, and returns the first cell left for the caller's scalar tail. Without
+// vector intrinsics they return First unchanged.
+namespace FluidVectorKernels
+{
+	// div = -0.5 * (dVx/dx + dVy/dy) / Size and p = 0, as in the first loop of AFluidGrid::Project
+	int32 DivergenceRow(float* div, float* p, const float* velocX, const float* velocY, int32 First, int32 End, int32 Size);
+
+	// Velocity -= 0.5 * grad(p) * Size, as in the second loop of AFluidGrid::Project
+	int32 SubtractGradientRow(float* velocX, float* velocY, const float* p, int32 First, int32 End, int32 Size);
+
+	// Semi-Lagrangian backtrace and bilinear sample for columns [First, End) of row j, as in AFluidGrid::Advect.
+	// The backtrace is computed once and reused for every one of the NumFields fields moved by velocX/velocY.
+	// The four corner reads are per-lane loads; the weights and the blend are vectorized.
+	int32 AdvectRow(float* const* d, const float* const* d0, int32 NumFields, const float* velocX, const float* velocY,
+		int32 j, int32 First, int32 End, int32 Size, float dtx, float dty);
+
+	// One row of a brush splat, as in FFluidSolver2D::ApplyBrushStrokes: Field[Index] += Amount * w * w with
+	// w = max(1 - ((x - CenterX)^2 + dy2) * InvRadiusSq, 0), for cells [First, End) of a row starting at Row
+	int32 SplatRow(float* const* Fields, const float* Amounts, int32 NumFields, int32 Row, int32 First, int32 End,
+		float CenterX, float dy2, float InvRadiusSq);
+
+	// The FFluidSolver3D versions of the Project and Advect rows: cells [First, End) are flat indices into a
+	// Size^3 volume, and z neighbours are Size * Size apart
+	int32 DivergenceRow3D(float* div, float* p, const float* velocX, const float* velocY, const float* velocZ, int32 First, int32 End, int32 Size);
+	int32 SubtractGradientRow3D(float* velocX, float* velocY, float* velocZ, const float* p, int32 First, int32 End, int32 Size);
+
+	// Trilinear samples for columns [First, End) of row (j, k); the eight corner reads are per-lane loads
+	int32 AdvectRow3D(float* const* d, const float* const* d0, int32 NumFields, const float* velocX, const float* velocY, const float* velocZ,
+		int32 j, int32 k, int32 First, int32 End, int32 Size, float dt0);
+}
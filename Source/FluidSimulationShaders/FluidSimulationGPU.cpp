@@ -0,0 +1,384 @@
+#include "FluidSimulationGPU.h"
+#include "GlobalShader.h"
+#include "ShaderParameterStruct.h"
+#include "RenderGraphBuilder.h"
+#include "RenderGraphUtils.h"
+#include "RenderTargetPool.h"
+#include "RHICommandList.h"
+
+static constexpr int32 FluidThreadGroupSize = 8;
+static constexpr int32 FluidBoundaryThreadGroupSize = 64;
+
+class FFluidShader : public FGlobalShader
+{
+public:
+	FFluidShader() = default;
+	FFluidShader(const ShaderMetaType::CompiledShaderInitializerType& Initializer) : FGlobalShader(Initializer) {}
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+	{
+		return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
+	}
+
+	static void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+	{
+		FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+		OutEnvironment.SetDefine(TEXT("THREADGROUP_SIZE"), FluidThreadGroupSize);
+		OutEnvironment.SetDefine(TEXT("BOUNDARY_THREADGROUP_SIZE"), FluidBoundaryThreadGroupSize);
+	}
+};
+
+class FFluidInjectCS : public FFluidShader
+{
+	DECLARE_GLOBAL_SHADER(FFluidInjectCS);
+	SHADER_USE_PARAMETER_STRUCT(FFluidInjectCS, FFluidShader);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER(int32, GridSize)
+		SHADER_PARAMETER(int32, AreaSize)
+		SHADER_PARAMETER(float, AffectedDensity)
+		SHADER_PARAMETER(float, TurbulenceScale)
+		SHADER_PARAMETER(float, TurbulenceOffset)
+		SHADER_PARAMETER(float, TurbulenceAmplitude)
+		SHADER_PARAMETER(int32, NumBrushStrokes)
+		SHADER_PARAMETER(float, BrushDensity)
+		SHADER_PARAMETER_RDG_BUFFER_SRV(StructuredBuffer<FBrushStroke>, BrushStrokes)
+		SHADER_PARAMETER_RDG_BUFFER_UAV(RWStructuredBuffer<float>, RWDensity)
+		SHADER_PARAMETER_RDG_BUFFER_UAV(RWStructuredBuffer<float>, RWVelocityX)
+		SHADER_PARAMETER_RDG_BUFFER_UAV(RWStructuredBuffer<float>, RWVelocityY)
+	END_SHADER_PARAMETER_STRUCT()
+};
+
+class FFluidRelaxCS : public FFluidShader
+{
+	DECLARE_GLOBAL_SHADER(FFluidRelaxCS);
+	SHADER_USE_PARAMETER_STRUCT(FFluidRelaxCS, FFluidShader);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER(int32, GridSize)
+		SHADER_PARAMETER(int32, Color)
+		SHADER_PARAMETER(float, A)
+		SHADER_PARAMETER(float, CRecip)
+		SHADER_PARAMETER_RDG_BUFFER_SRV(StructuredBuffer<float>, X0)
+		SHADER_PARAMETER_RDG_BUFFER_UAV(RWStructuredBuffer<float>, X)
+	END_SHADER_PARAMETER_STRUCT()
+};
+
+BEGIN_SHADER_PARAMETER_STRUCT(FFluidBoundaryParameters, )
+	SHADER_PARAMETER(int32, GridSize)
+	SHADER_PARAMETER(int32, BoundaryMode)
+	SHADER_PARAMETER_RDG_BUFFER_UAV(RWStructuredBuffer<float>, X)
+END_SHADER_PARAMETER_STRUCT()
+
+class FFluidBoundaryEdgesCS : public FFluidShader
+{
+	DECLARE_GLOBAL_SHADER(FFluidBoundaryEdgesCS);
+	SHADER_USE_PARAMETER_STRUCT(FFluidBoundaryEdgesCS, FFluidShader);
+	using FParameters = FFluidBoundaryParameters;
+};
+
+class FFluidBoundaryCornersCS : public FFluidShader
+{
+	DECLARE_GLOBAL_SHADER(FFluidBoundaryCornersCS);
+	SHADER_USE_PARAMETER_STRUCT(FFluidBoundaryCornersCS, FFluidShader);
+	using FParameters = FFluidBoundaryParameters;
+};
+
+class FFluidAdvectCS : public FFluidShader
+{
+	DECLARE_GLOBAL_SHADER(FFluidAdvectCS);
+	SHADER_USE_PARAMETER_STRUCT(FFluidAdvectCS, FFluidShader);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER(int32, GridSize)
+		SHADER_PARAMETER(float, Dt)
+		SHADER_PARAMETER_RDG_BUFFER_SRV(StructuredBuffer<float>, X0)
+		SHADER_PARAMETER_RDG_BUFFER_SRV(StructuredBuffer<float>, VelocityX)
+		SHADER_PARAMETER_RDG_BUFFER_SRV(StructuredBuffer<float>, VelocityY)
+		SHADER_PARAMETER_RDG_BUFFER_UAV(RWStructuredBuffer<float>, X)
+	END_SHADER_PARAMETER_STRUCT()
+};
+
+class FFluidDivergenceCS : public FFluidShader
+{
+	DECLARE_GLOBAL_SHADER(FFluidDivergenceCS);
+	SHADER_USE_PARAMETER_STRUCT(FFluidDivergenceCS, FFluidShader);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER(int32, GridSize)
+		SHADER_PARAMETER_RDG_BUFFER_SRV(StructuredBuffer<float>, VelocityX)
+		SHADER_PARAMETER_RDG_BUFFER_SRV(StructuredBuffer<float>, VelocityY)
+		SHADER_PARAMETER_RDG_BUFFER_UAV(RWStructuredBuffer<float>, RWDivergence)
+		SHADER_PARAMETER_RDG_BUFFER_UAV(RWStructuredBuffer<float>, RWPressure)
+	END_SHADER_PARAMETER_STRUCT()
+};
+
+class FFluidSubtractGradientCS : public FFluidShader
+{
+	DECLARE_GLOBAL_SHADER(FFluidSubtractGradientCS);
+	SHADER_USE_PARAMETER_STRUCT(FFluidSubtractGradientCS, FFluidShader);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER(int32, GridSize)
+		SHADER_PARAMETER_RDG_BUFFER_SRV(StructuredBuffer<float>, Pressure)
+		SHADER_PARAMETER_RDG_BUFFER_UAV(RWStructuredBuffer<float>, RWVelocityX)
+		SHADER_PARAMETER_RDG_BUFFER_UAV(RWStructuredBuffer<float>, RWVelocityY)
+	END_SHADER_PARAMETER_STRUCT()
+};
+
+class FFluidFadeCS : public FFluidShader
+{
+	DECLARE_GLOBAL_SHADER(FFluidFadeCS);
+	SHADER_USE_PARAMETER_STRUCT(FFluidFadeCS, FFluidShader);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER(int32, GridSize)
+		SHADER_PARAMETER(float, FadeScale)
+		SHADER_PARAMETER(float, FadeAmount)
+		SHADER_PARAMETER(float, FadeCutoff)
+		SHADER_PARAMETER_RDG_BUFFER_UAV(RWStructuredBuffer<float>, X)
+	END_SHADER_PARAMETER_STRUCT()
+};
+
+class FFluidColorMapCS : public FFluidShader
+{
+	DECLARE_GLOBAL_SHADER(FFluidColorMapCS);
+	SHADER_USE_PARAMETER_STRUCT(FFluidColorMapCS, FFluidShader);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER(int32, GridSize)
+		SHADER_PARAMETER(int32, PaletteSize)
+		SHADER_PARAMETER_RDG_BUFFER_SRV(StructuredBuffer<float>, X0)
+		SHADER_PARAMETER_RDG_BUFFER_SRV(StructuredBuffer<uint>, Palette)
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D<float4>, Output)
+	END_SHADER_PARAMETER_STRUCT()
+};
+
+IMPLEMENT_GLOBAL_SHADER(FFluidInjectCS, "/FluidSimulation/Private/FluidSimulation.usf", "InjectCS", SF_Compute);
+IMPLEMENT_GLOBAL_SHADER(FFluidRelaxCS, "/FluidSimulation/Private/FluidSimulation.usf", "RelaxCS", SF_Compute);
+IMPLEMENT_GLOBAL_SHADER(FFluidBoundaryEdgesCS, "/FluidSimulation/Private/FluidSimulation.usf", "BoundaryEdgesCS", SF_Compute);
+IMPLEMENT_GLOBAL_SHADER(FFluidBoundaryCornersCS, "/FluidSimulation/Private/FluidSimulation.usf", "BoundaryCornersCS", SF_Compute);
+IMPLEMENT_GLOBAL_SHADER(FFluidAdvectCS, "/FluidSimulation/Private/FluidSimulation.usf", "AdvectCS", SF_Compute);
+IMPLEMENT_GLOBAL_SHADER(FFluidDivergenceCS, "/FluidSimulation/Private/FluidSimulation.usf", "DivergenceCS", SF_Compute);
+IMPLEMENT_GLOBAL_SHADER(FFluidSubtractGradientCS, "/FluidSimulation/Private/FluidSimulation.usf", "SubtractGradientCS", SF_Compute);
+IMPLEMENT_GLOBAL_SHADER(FFluidFadeCS, "/FluidSimulation/Private/FluidSimulation.usf", "FadeCS", SF_Compute);
+IMPLEMENT_GLOBAL_SHADER(FFluidColorMapCS, "/FluidSimulation/Private/FluidSimulation.usf", "ColorMapCS", SF_Compute);
+
+namespace
+{
+	// Builds the passes of one step. Mirrors the CPU functions of the same names on AFluidGrid.
+	class FFluidPassBuilder
+	{
+	public:
+		FFluidPassBuilder(FRDGBuilder& InGraphBuilder, int32 InSize)
+			: GraphBuilder(InGraphBuilder)
+			, ShaderMap(GetGlobalShaderMap(GMaxRHIFeatureLevel))
+			, Size(InSize)
+		{
+		}
+
+		FIntVector InteriorGroups() const
+		{
+			return FComputeShaderUtils::GetGroupCount(FIntPoint(Size - 2, Size - 2), FluidThreadGroupSize);
+		}
+
+		void SetBoundary(int32 b, FRDGBufferRef x)
+		{
+			FFluidBoundaryParameters* EdgeParameters = GraphBuilder.AllocParameters<FFluidBoundaryParameters>();
+			EdgeParameters->GridSize = Size;
+			EdgeParameters->BoundaryMode = b;
+			EdgeParameters->X = GraphBuilder.CreateUAV(x);
+			FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("FluidBoundaryEdges"), TShaderMapRef<FFluidBoundaryEdgesCS>(ShaderMap),
+				EdgeParameters, FComputeShaderUtils::GetGroupCount(Size - 2, FluidBoundaryThreadGroupSize));
+
+			// The corners average two edge cells, so they need the edge pass to have finished
+			FFluidBoundaryParameters* CornerParameters = GraphBuilder.AllocParameters<FFluidBoundaryParameters>();
+			*CornerParameters = *EdgeParameters;
+			FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("FluidBoundaryCorners"), TShaderMapRef<FFluidBoundaryCornersCS>(ShaderMap),
+				CornerParameters, FIntVector(1, 1, 1));
+		}
+
+		void LinearSolve(int32 b, FRDGBufferRef x, FRDGBufferRef x0, float a, float c, int32 Iterations)
+		{
+			RDG_EVENT_SCOPE(GraphBuilder, "FluidLinearSolve");
+			const FIntVector Groups = FComputeShaderUtils::GetGroupCount(FIntPoint((Size - 1) / 2, Size - 2), FluidThreadGroupSize);
+			for (int32 t = 0; t < Iterations; t++)
+			{
+				for (int32 Color = 0; Color < 2; Color++)
+				{
+					FFluidRelaxCS::FParameters* Parameters = GraphBuilder.AllocParameters<FFluidRelaxCS::FParameters>();
+					Parameters->GridSize = Size;
+					Parameters->Color = Color;
+					Parameters->A = a;
+					Parameters->CRecip = 1.0f / c;
+					Parameters->X0 = GraphBuilder.CreateSRV(x0);
+					Parameters->X = GraphBuilder.CreateUAV(x);
+					FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("FluidRelax"), TShaderMapRef<FFluidRelaxCS>(ShaderMap), Parameters, Groups);
+				}
+				SetBoundary(b, x);
+			}
+		}
+
+		void Diffuse(int32 b, FRDGBufferRef x, FRDGBufferRef x0, float diff, float dt, int32 Iterations)
+		{
+			// The CPU path seeds its solve from x0; here the copy is a single cheap GPU pass
+			AddCopyBufferPass(GraphBuilder, x, x0);
+			float a = dt * diff * (Size - 2) * (Size - 2);
+			LinearSolve(b, x, x0, a, 1 + 4 * a, Iterations);
+		}
+
+		void Advect(int32 b, FRDGBufferRef d, FRDGBufferRef d0, FRDGBufferRef velocX, FRDGBufferRef velocY, float dt)
+		{
+			FFluidAdvectCS::FParameters* Parameters = GraphBuilder.AllocParameters<FFluidAdvectCS::FParameters>();
+			Parameters->GridSize = Size;
+			Parameters->Dt = dt;
+			Parameters->X0 = GraphBuilder.CreateSRV(d0);
+			Parameters->VelocityX = GraphBuilder.CreateSRV(velocX);
+			Parameters->VelocityY = GraphBuilder.CreateSRV(velocY);
+			Parameters->X = GraphBuilder.CreateUAV(d);
+			FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("FluidAdvect"), TShaderMapRef<FFluidAdvectCS>(ShaderMap), Parameters, InteriorGroups());
+			SetBoundary(b, d);
+		}
+
+		void Project(FRDGBufferRef velocX, FRDGBufferRef velocY, FRDGBufferRef p, FRDGBufferRef div, int32 Iterations)
+		{
+			RDG_EVENT_SCOPE(GraphBuilder, "FluidProject");
+
+			FFluidDivergenceCS::FParameters* DivergenceParameters = GraphBuilder.AllocParameters<FFluidDivergenceCS::FParameters>();
+			DivergenceParameters->GridSize = Size;
+			DivergenceParameters->VelocityX = GraphBuilder.CreateSRV(velocX);
+			DivergenceParameters->VelocityY = GraphBuilder.CreateSRV(velocY);
+			DivergenceParameters->RWDivergence = GraphBuilder.CreateUAV(div);
+			DivergenceParameters->RWPressure = GraphBuilder.CreateUAV(p);
+			FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("FluidDivergence"), TShaderMapRef<FFluidDivergenceCS>(ShaderMap), DivergenceParameters, InteriorGroups());
+
+			SetBoundary(0, div);
+			SetBoundary(0, p);
+			LinearSolve(0, p, div, 1, 6, Iterations);
+
+			FFluidSubtractGradientCS::FParameters* GradientParameters = GraphBuilder.AllocParameters<FFluidSubtractGradientCS::FParameters>();
+			GradientParameters->GridSize = Size;
+			GradientParameters->Pressure = GraphBuilder.CreateSRV(p);
+			GradientParameters->RWVelocityX = GraphBuilder.CreateUAV(velocX);
+			GradientParameters->RWVelocityY = GraphBuilder.CreateUAV(velocY);
+			FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("FluidSubtractGradient"), TShaderMapRef<FFluidSubtractGradientCS>(ShaderMap), GradientParameters, InteriorGroups());
+
+			SetBoundary(1, velocX);
+			SetBoundary(2, velocY);
+		}
+
+		FRDGBuilder& GraphBuilder;
+		FGlobalShaderMap* ShaderMap;
+		int32 Size;
+	};
+}
+
+void FFluidGPUSimulation::Step_RenderThread(FRHICommandListImmediate& RHICmdList, const FFluidGPUStepParams& Params, FRHITexture* OutputTexture)
+{
+	check(IsInRenderingThread());
+
+	const int32 Size = Params.Size;
+	FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("FluidSimulation"));
+	FFluidPassBuilder Passes(GraphBuilder, Size);
+
+	FRDGBufferRef Buffers[NumFields];
+	if (AllocatedSize != Size)
+	{
+		for (int32 Field = 0; Field < NumFields; Field++)
+		{
+			Buffers[Field] = GraphBuilder.CreateBuffer(FRDGBufferDesc::CreateStructuredDesc(sizeof(float), Size * Size), TEXT("FluidSimulation.Field"));
+			AddClearUAVPass(GraphBuilder, GraphBuilder.CreateUAV(Buffers[Field]), 0u);
+			Fields[Field] = GraphBuilder.ConvertToExternalBuffer(Buffers[Field]);
+		}
+		AllocatedSize = Size;
+	}
+	else
+	{
+		for (int32 Field = 0; Field < NumFields; Field++)
+		{
+			Buffers[Field] = GraphBuilder.RegisterExternalBuffer(Fields[Field]);
+		}
+	}
+
+	// Sources and brush strokes land in the front buffers, as AddDensity/AddVelocity do on the CPU
+	{
+		// The SRV needs at least one element even on frames without strokes
+		const int32 NumStrokes = Params.BrushStrokes.Num();
+		const FFluidGPUBrushStroke NoStroke;
+		FRDGBufferRef StrokeBuffer = CreateStructuredBuffer(GraphBuilder, TEXT("FluidSimulation.BrushStrokes"), sizeof(FFluidGPUBrushStroke), FMath::Max(NumStrokes, 1),
+			NumStrokes > 0 ? Params.BrushStrokes.GetData() : &NoStroke, FMath::Max(NumStrokes, 1) * sizeof(FFluidGPUBrushStroke));
+
+		FFluidInjectCS::FParameters* Parameters = GraphBuilder.AllocParameters<FFluidInjectCS::FParameters>();
+		Parameters->GridSize = Size;
+		Parameters->AreaSize = Params.AreaSize;
+		Parameters->AffectedDensity = Params.AffectedDensity;
+		Parameters->TurbulenceScale = Params.TurbulenceScale;
+		Parameters->TurbulenceOffset = Params.TurbulenceOffset;
+		Parameters->TurbulenceAmplitude = Params.TurbulenceAmplitude;
+		Parameters->NumBrushStrokes = NumStrokes;
+		Parameters->BrushDensity = Params.BrushDensity;
+		Parameters->BrushStrokes = GraphBuilder.CreateSRV(StrokeBuffer);
+		Parameters->RWDensity = GraphBuilder.CreateUAV(Buffers[Density]);
+		Parameters->RWVelocityX = GraphBuilder.CreateUAV(Buffers[Vx]);
+		Parameters->RWVelocityY = GraphBuilder.CreateUAV(Buffers[Vy]);
+		FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("FluidInject"), TShaderMapRef<FFluidInjectCS>(Passes.ShaderMap), Parameters,
+			FComputeShaderUtils::GetGroupCount(FIntPoint(Size, Size), FluidThreadGroupSize));
+	}
+
+	// Same front/back swap and data flow as AFluidGrid::StepSimulation
+	Swap(Buffers[Vx], Buffers[Vx0]);
+	Swap(Buffers[Vy], Buffers[Vy0]);
+	Swap(Buffers[Density], Buffers[Density0]);
+	Swap(Fields[Vx], Fields[Vx0]);
+	Swap(Fields[Vy], Fields[Vy0]);
+	Swap(Fields[Density], Fields[Density0]);
+
+	Passes.Diffuse(1, Buffers[Vx], Buffers[Vx0], Params.Viscosity, Params.Dt, Params.DiffuseIterations);
+	Passes.Diffuse(2, Buffers[Vy], Buffers[Vy0], Params.Viscosity, Params.Dt, Params.DiffuseIterations);
+
+	Passes.Project(Buffers[Vx], Buffers[Vy], Buffers[Vx0], Buffers[Vy0], Params.PressureIterations);
+
+	Passes.Advect(1, Buffers[Vx], Buffers[Vx0], Buffers[Vx0], Buffers[Vy0], Params.Dt);
+	Passes.Advect(2, Buffers[Vy], Buffers[Vy0], Buffers[Vx0], Buffers[Vy0], Params.Dt);
+
+	Passes.Project(Buffers[Vx], Buffers[Vy], Buffers[Vx0], Buffers[Vy0], Params.PressureIterations);
+
+	Passes.Diffuse(0, Buffers[Density], Buffers[Density0], Params.Diffusion, Params.Dt, Params.DiffuseIterations);
+
+	Passes.Advect(0, Buffers[Density], Buffers[Density0], Buffers[Vx], Buffers[Vy], Params.Dt);
+
+	Passes.SetBoundary(0, Buffers[Density]);
+	Passes.SetBoundary(1, Buffers[Vx]);
+	Passes.SetBoundary(2, Buffers[Vy]);
+
+	{
+		FFluidFadeCS::FParameters* Parameters = GraphBuilder.AllocParameters<FFluidFadeCS::FParameters>();
+		Parameters->GridSize = Size;
+		Parameters->FadeScale = Params.FadeScale;
+		Parameters->FadeAmount = Params.FadeAmount;
+		Parameters->FadeCutoff = Params.FadeCutoff;
+		Parameters->X = GraphBuilder.CreateUAV(Buffers[Density]);
+		FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("FluidFade"), TShaderMapRef<FFluidFadeCS>(Passes.ShaderMap), Parameters,
+			FComputeShaderUtils::GetGroupCount(FIntPoint(Size, Size), FluidThreadGroupSize));
+	}
+
+	{
+		FRDGTextureRef Output = GraphBuilder.RegisterExternalTexture(CreateRenderTarget(OutputTexture, TEXT("FluidSimulation.Output")));
+
+		const FColor Black = FColor::Black;
+		const int32 PaletteSize = FMath::Max(Params.Palette.Num(), 1);
+		FRDGBufferRef PaletteBuffer = CreateStructuredBuffer(GraphBuilder, TEXT("FluidSimulation.Palette"), sizeof(FColor), PaletteSize,
+			Params.Palette.Num() > 0 ? Params.Palette.GetData() : &Black, PaletteSize * sizeof(FColor));
+
+		FFluidColorMapCS::FParameters* Parameters = GraphBuilder.AllocParameters<FFluidColorMapCS::FParameters>();
+		Parameters->GridSize = Size;
+		Parameters->PaletteSize = PaletteSize;
+		Parameters->X0 = GraphBuilder.CreateSRV(Buffers[Density]);
+		Parameters->Palette = GraphBuilder.CreateSRV(PaletteBuffer);
+		Parameters->Output = GraphBuilder.CreateUAV(Output);
+		FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("FluidColorMap"), TShaderMapRef<FFluidColorMapCS>(Passes.ShaderMap), Parameters,
+			FComputeShaderUtils::GetGroupCount(FIntPoint(Size, Size), FluidThreadGroupSize));
+	}
+
+	GraphBuilder.Execute();
+}
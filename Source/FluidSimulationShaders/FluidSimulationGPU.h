@@ -0,0 +1,61 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "RenderGraphResources.h"
+
+class FRHICommandListImmediate;
+class FRHITexture;
+
+// One brush stroke in grid cells, laid out as the shader's FBrushStroke
+struct FFluidGPUBrushStroke
+{
+	FVector2f Center = FVector2f::ZeroVector; // Cell coordinates; cell x's centre is at x
+	FVector2f Velocity = FVector2f::ZeroVector;
+	float Radius = 1.5f;                       // In cells
+};
+
+// Everything one GPU step needs from AFluidGrid, captured by value on the game thread
+struct FFluidGPUStepParams
+{
+	int32 Size = 256;
+	float Dt = 0.2f;
+	float Viscosity = 0.0002f;
+	float Diffusion = 0.0002f;
+	int32 DiffuseIterations = 20;
+	int32 PressureIterations = 20;
+
+	// Source injection, matching AFluidGrid::InjectSources
+	int32 AreaSize = 100;
+	float AffectedDensity = 10.0f;
+	float TurbulenceScale = 15.0f;
+	float TurbulenceOffset = 0.0f; // Time * TurbulenceSpeed
+	float TurbulenceAmplitude = 120.0f;
+
+	// This step's brush strokes, splatted as in FFluidSolver2D::ApplyBrushStrokes
+	TArray<FFluidGPUBrushStroke> BrushStrokes;
+	float BrushDensity = 500.0f;
+
+	// FFluidFadeTerms: clamp(Density * FadeScale - FadeAmount), then zero below FadeCutoff
+	float FadeScale = 1.0f;
+	float FadeAmount = 0.5f;
+	float FadeCutoff = 0.0f;
+
+	// AFluidGrid::PaletteLUT, sampled by the colour map
+	TArray<FColor> Palette;
+};
+
+// The full StepSimulation pipeline as global compute shaders. Density and velocity live in pooled
+// structured buffers on the GPU with the same row-major layout as the CPU solver, and the colour-mapped
+// result is written straight into the render target, so nothing is read back.
+class FLUIDSIMULATIONSHADERS_API FFluidGPUSimulation
+{
+public:
+	// Render thread only. OutputTexture must have been created with UAV support.
+	void Step_RenderThread(FRHICommandListImmediate& RHICmdList, const FFluidGPUStepParams& Params, FRHITexture* OutputTexture);
+
+private:
+	enum EField { Density, Density0, Vx, Vx0, Vy, Vy0, NumFields };
+
+	TRefCountPtr<FRDGPooledBuffer> Fields[NumFields];
+	int32 AllocatedSize = 0;
+};
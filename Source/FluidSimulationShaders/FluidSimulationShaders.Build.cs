@@ -0,0 +1,15 @@
+using UnrealBuildTool;
+
+public class FluidSimulationShaders : ModuleRules
+{
+	public FluidSimulationShaders(ReadOnlyTargetRules Target) : base(Target)
+	{
+		PCHUsage = PCHUsageMode.UseExplicitOrSharedPCHs;
+
+		PublicIncludePaths.Add(ModuleDirectory);
+
+		PublicDependencyModuleNames.AddRange(new string[] { "Core", "RHI", "RenderCore" });
+
+		PrivateDependencyModuleNames.AddRange(new string[] { "CoreUObject", "Engine" });
+	}
+}
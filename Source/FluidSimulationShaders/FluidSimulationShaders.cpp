@@ -0,0 +1,15 @@
+#include "Modules/ModuleManager.h"
+#include "Misc/Paths.h"
+#include "ShaderCore.h"
+
+// Loaded at PostConfigInit so the /FluidSimulation shader directory is mapped before global shaders compile
+class FFluidSimulationShadersModule : public IModuleInterface
+{
+public:
+	virtual void StartupModule() override
+	{
+		AddShaderSourceDirectoryMapping(TEXT("/FluidSimulation"), FPaths::Combine(FPaths::ProjectDir(), TEXT("Shaders")));
+	}
+};
+
+IMPLEMENT_MODULE(FFluidSimulationShadersModule, FluidSimulationShaders);